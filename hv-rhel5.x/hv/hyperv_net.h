@@ -179,6 +179,9 @@ struct rndis_device {
 };
 
 
+struct netvsc_device;
+struct netvsc_channel;
+
 /* Interface */
 int netvsc_device_add(struct hv_device *device, void *additional_info);
 int netvsc_device_remove(struct hv_device *device);
@@ -190,6 +193,9 @@ int netvsc_recv_callback(struct hv_device *device_obj,
 			struct hv_netvsc_packet *packet,
 			struct ndis_tcp_ip_checksum_info *csum_info);
 void netvsc_channel_cb(void *context);
+void netvsc_chan_poll_init(struct netvsc_channel *nvchan,
+			   struct netvsc_device *net_device,
+			   struct vmbus_channel *channel);
 int rndis_filter_open(struct hv_device *dev);
 int rndis_filter_close(struct hv_device *dev);
 int rndis_filter_device_add(struct hv_device *dev,
@@ -604,6 +610,20 @@ struct net_device_context {
 	u32 msg_enable;
 };
 
+/*
+ * Per vmbus channel receive state. This kernel predates napi_struct, so
+ * each channel gets its own dummy polling net_device (as e1000 does for
+ * its rx queues) that is scheduled from the channel callback.
+ */
+#define NETVSC_POLL_WEIGHT	64
+
+struct netvsc_channel {
+	struct net_device poll_dev;
+	struct vmbus_channel *channel;
+	struct netvsc_device *net_device;
+	struct vmpacket_descriptor *desc;	/* next packet to process */
+};
+
 /* Per netvsc channel-specific */
 struct netvsc_device {
 	struct hv_device *dev;
@@ -650,10 +670,10 @@ struct netvsc_device {
 
 	int ring_size;
 
-	/* The primary channel callback buffer */
-	unsigned char *cb_buffer;
-	/* The sub channel callback buffer */
-	unsigned char *sub_cb_buf;
+	/* The primary channel receive state */
+	struct netvsc_channel *prim_chan;
+	/* The sub channel receive states */
+	struct netvsc_channel *sub_chan;
 
 	/* The net device context */
 	struct net_device_context *nd_ctx;
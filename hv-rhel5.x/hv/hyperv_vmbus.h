@@ -640,9 +640,7 @@ int hv_ringbuffer_read(struct hv_ring_buffer_info *ring_info,
 void hv_ringbuffer_get_debuginfo(struct hv_ring_buffer_info *ring_info,
 			    struct hv_ring_buffer_debug_info *debug_info);
 
-void hv_begin_read(struct hv_ring_buffer_info *rbi);
-
-u32 hv_end_read(struct hv_ring_buffer_info *rbi);
+void vmbus_setevent(struct vmbus_channel *channel);
 
 /*
  * Maximum channels is determined by the size of the interrupt page
@@ -42,8 +42,9 @@ static struct netvsc_device *alloc_net_device(struct hv_device *device)
 	if (!net_device)
 		return NULL;
 
-	net_device->cb_buffer = kzalloc(NETVSC_PACKET_SIZE, GFP_KERNEL);
-	if (!net_device->cb_buffer) {
+	net_device->prim_chan = kzalloc(sizeof(struct netvsc_channel),
+					GFP_KERNEL);
+	if (!net_device->prim_chan) {
 		kfree(net_device);
 		return NULL;
 	}
@@ -60,7 +61,7 @@ static struct netvsc_device *alloc_net_device(struct hv_device *device)
 
 static void free_netvsc_device(struct netvsc_device *nvdev)
 {
-	kfree(nvdev->cb_buffer);
+	kfree(nvdev->prim_chan);
 	kfree(nvdev);
 }
 
@@ -536,6 +537,7 @@ int netvsc_device_remove(struct hv_device *device)
 {
 	struct netvsc_device *net_device;
 	unsigned long flags;
+	int i;
 
 	net_device = hv_get_drvdata(device);
 
@@ -559,11 +561,17 @@ int netvsc_device_remove(struct hv_device *device)
 	 */
 	dev_notice(&device->device, "net device safe to remove\n");
 
+	/* Wait for running polls and keep new ones from being scheduled */
+	netif_poll_disable(&net_device->prim_chan->poll_dev);
+	for (i = 1; i < net_device->num_chn; i++)
+		if (net_device->chn_table[i])
+			netif_poll_disable(&net_device->sub_chan[i - 1].poll_dev);
+
 	/* Now, we can close the channel safely */
 	vmbus_close(device->channel);
 
 	/* Release all resources */
-	vfree(net_device->sub_cb_buf);
+	vfree(net_device->sub_chan);
 	free_netvsc_device(net_device);
 	return 0;
 }
@@ -859,7 +867,7 @@ retry_send_cmplt:
 	}
 }
 
-static void netvsc_receive(struct netvsc_device *net_device,
+static int netvsc_receive(struct netvsc_device *net_device,
 			struct vmbus_channel *channel,
 			struct hv_device *device,
 			struct vmpacket_descriptor *packet)
@@ -882,7 +890,7 @@ static void netvsc_receive(struct netvsc_device *net_device,
 	if (packet->type != VM_PKT_DATA_USING_XFER_PAGES) {
 		netdev_err(ndev, "Unknown packet type received - %d\n",
 			   packet->type);
-		return;
+		return 0;
 	}
 
 	nvsp_packet = (struct nvsp_message *)((unsigned long)packet +
@@ -893,7 +901,7 @@ static void netvsc_receive(struct netvsc_device *net_device,
 	    NVSP_MSG1_TYPE_SEND_RNDIS_PKT) {
 		netdev_err(ndev, "Unknown nvsp packet type received-"
 			" %d\n", nvsp_packet->hdr.msg_type);
-		return;
+		return 0;
 	}
 
 	vmxferpage_packet = (struct vmtransfer_page_packet_header *)packet;
@@ -902,7 +910,7 @@ static void netvsc_receive(struct netvsc_device *net_device,
 		netdev_err(ndev, "Invalid xfer page set id - "
 			   "expecting %x got %x\n", NETVSC_RECEIVE_BUFFER_ID,
 			   vmxferpage_packet->xfer_pageset_id);
-		return;
+		return 0;
 	}
 
 	count = vmxferpage_packet->range_cnt;
@@ -926,6 +934,8 @@ static void netvsc_receive(struct netvsc_device *net_device,
 
 	netvsc_send_recv_completion(device, channel, net_device,
 				    vmxferpage_packet->d.trans_id, status);
+
+	return count;
 }
 
 
@@ -962,87 +972,136 @@ static void netvsc_send_table(struct hv_device *hdev,
 		nvscdev->send_table[i] = tab[i];
 }
 
-void netvsc_channel_cb(void *context)
+static struct hv_device *netvsc_channel_to_device(struct vmbus_channel *channel)
 {
-	int ret;
-	struct vmbus_channel *channel = (struct vmbus_channel *)context;
-	struct hv_device *device;
-	struct netvsc_device *net_device;
-	u32 bytes_recvd;
-	u64 request_id;
-	struct vmpacket_descriptor *desc;
-	unsigned char *buffer;
-	int bufferlen = NETVSC_PACKET_SIZE;
-	struct net_device *ndev;
+	struct vmbus_channel *primary = channel->primary_channel;
 
-	if (channel->primary_channel != NULL)
-		device = channel->primary_channel->device_obj;
-	else
-		device = channel->device_obj;
+	return primary ? primary->device_obj : channel->device_obj;
+}
+
+static int netvsc_process_raw_pkt(struct hv_device *device,
+				  struct vmbus_channel *channel,
+				  struct netvsc_device *net_device,
+				  struct vmpacket_descriptor *desc)
+{
+	switch (desc->type) {
+	case VM_PKT_COMP:
+		netvsc_send_completion(net_device, device, desc);
+		break;
+
+	case VM_PKT_DATA_USING_XFER_PAGES:
+		return netvsc_receive(net_device, channel, device, desc);
+
+	case VM_PKT_DATA_INBAND:
+		netvsc_send_table(device, desc);
+		break;
+
+	default:
+		netdev_err(net_device->ndev,
+			   "unhandled packet type %d, tid %llx len %d\n",
+			   desc->type, desc->trans_id, desc->len8 << 3);
+		break;
+	}
+
+	return 0;
+}
+
+/* Mask host interrupts and queue the channel for polling */
+static void netvsc_chan_schedule(struct netvsc_channel *nvchan)
+{
+	if (netif_rx_schedule_prep(&nvchan->poll_dev)) {
+		/* disable interrupts from host */
+		hv_begin_read(&nvchan->channel->inbound);
+
+		__netif_rx_schedule(&nvchan->poll_dev);
+	}
+}
+
+/*
+ * Network processing softirq
+ * Process data in incoming ring buffer from host, in place.
+ * Stops when ring is empty or budget is met or exceeded.
+ */
+static int netvsc_poll(struct net_device *poll_dev, int *budget)
+{
+	struct netvsc_channel *nvchan = poll_dev->priv;
+	struct vmbus_channel *channel = nvchan->channel;
+	struct hv_device *device = netvsc_channel_to_device(channel);
+	struct netvsc_device *net_device;
+	int work_to_do = min(*budget, poll_dev->quota);
+	int work_done = 0;
 
 	net_device = get_inbound_net_device(device);
-	if (!net_device)
-		return;
-	ndev = net_device->ndev;
-	buffer = get_per_channel_state(channel);
-
-	do {
-		ret = vmbus_recvpacket_raw(channel, buffer, bufferlen,
-					   &bytes_recvd, &request_id);
-		if (ret == 0) {
-			if (bytes_recvd > 0) {
-				desc = (struct vmpacket_descriptor *)buffer;
-				switch (desc->type) {
-				case VM_PKT_COMP:
-					netvsc_send_completion(net_device,
-								device, desc);
-					break;
-
-				case VM_PKT_DATA_USING_XFER_PAGES:
-					netvsc_receive(net_device, channel,
-						       device, desc);
-					break;
-
-				case VM_PKT_DATA_INBAND:
-					netvsc_send_table(device, desc);
-					break;
-
-				default:
-					netdev_err(ndev,
-						   "unhandled packet type %d, "
-						   "tid %llx len %d\n",
-						   desc->type, request_id,
-						   bytes_recvd);
-					break;
-				}
-
-			} else {
-				/*
-				 * We are done for this pass.
-				 */
-				break;
-			}
-
-		} else if (ret == -ENOBUFS) {
-			if (bufferlen > NETVSC_PACKET_SIZE)
-				kfree(buffer);
-			/* Handle large packet */
-			buffer = kmalloc(bytes_recvd, GFP_ATOMIC);
-			if (buffer == NULL) {
-				/* Try again next time around */
-				netdev_err(ndev,
-					   "unable to allocate buffer of size "
-					   "(%d)!!\n", bytes_recvd);
-				break;
-			}
-
-			bufferlen = bytes_recvd;
-		}
-	} while (1);
+	if (!net_device) {
+		/* Going away; leave host interrupts masked */
+		netif_rx_complete(poll_dev);
+		return 0;
+	}
+
+	/* If starting a new interval */
+	if (!nvchan->desc)
+		nvchan->desc = hv_pkt_iter_first(channel);
+
+	while (nvchan->desc && work_done < work_to_do) {
+		work_done += netvsc_process_raw_pkt(device, channel,
+						    net_device, nvchan->desc);
+		nvchan->desc = hv_pkt_iter_next(channel, nvchan->desc);
+	}
+
+	/* Driver may overshoot since multiple packets per descriptor */
+	work_done = min(work_done, work_to_do);
+	*budget -= work_done;
+	poll_dev->quota -= work_done;
+
+	if (nvchan->desc) {
+		/*
+		 * Out of budget: hand the space consumed so far back to
+		 * the host now rather than when the ring drains.
+		 */
+		hv_pkt_iter_close(channel);
+		return 1;
+	}
 
-	if (bufferlen > NETVSC_PACKET_SIZE)
-		kfree(buffer);
-	return;
+	/* Ring drained: re-enable host interrupts, recheck for a race */
+	netif_rx_complete(poll_dev);
+	if (hv_end_read(&channel->inbound))
+		netvsc_chan_schedule(nvchan);
+
+	return 0;
+}
+
+/*
+ * Call back when data is available in host ring buffer.
+ * Processing is deferred to the network softirq.
+ */
+void netvsc_channel_cb(void *context)
+{
+	netvsc_chan_schedule(context);
+}
+
+/*
+ * Set up receive polling for @channel; must be called before the
+ * channel is opened with netvsc_channel_cb and @nvchan as context.
+ */
+void netvsc_chan_poll_init(struct netvsc_channel *nvchan,
+			   struct netvsc_device *net_device,
+			   struct vmbus_channel *channel)
+{
+	struct net_device *poll_dev = &nvchan->poll_dev;
+
+	nvchan->channel = channel;
+	nvchan->net_device = net_device;
+	nvchan->desc = NULL;
+
+	poll_dev->priv = nvchan;
+	poll_dev->poll = netvsc_poll;
+	poll_dev->weight = NETVSC_POLL_WEIGHT;
+	dev_hold(poll_dev);
+	set_bit(__LINK_STATE_START, &poll_dev->state);
+
+	/* netvsc_poll() drains the ring, not the vmbus event loop */
+	set_channel_read_state(channel, false);
+	set_per_channel_state(channel, nvchan);
 }
 
 /*
@@ -1078,12 +1137,13 @@ int netvsc_device_add(struct hv_device *device, void *additional_info)
 	/* Initialize the NetVSC channel extension */
 	init_completion(&net_device->channel_init_wait);
 
-	set_per_channel_state(device->channel, net_device->cb_buffer);
+	netvsc_chan_poll_init(net_device->prim_chan, net_device,
+			      device->channel);
 
 	/* Open the channel */
 	ret = vmbus_open(device->channel, ring_size * PAGE_SIZE,
 			 ring_size * PAGE_SIZE, NULL, 0,
-			 netvsc_channel_cb, device->channel);
+			 netvsc_channel_cb, net_device->prim_chan);
 
 	if (ret != 0) {
 		netdev_err(ndev, "unable to open channel: %d\n", ret);
@@ -1106,6 +1166,8 @@ int netvsc_device_add(struct hv_device *device, void *additional_info)
 	return ret;
 
 close:
+	netif_poll_disable(&net_device->prim_chan->poll_dev);
+
 	/* Now, we can close the channel safely */
 	vmbus_close(device->channel);
 
@@ -707,10 +707,9 @@ int netvsc_recv_callback(struct hv_device *device_obj,
 
 	/*
 	 * Pass the skb back up. Network stack will deallocate the skb when it
-	 * is done.
-	 * TODO - use NAPI?
+	 * is done. We are called from netvsc_poll().
 	 */
-	netif_rx(skb);
+	netif_receive_skb(skb);
 
 	return 0;
 }
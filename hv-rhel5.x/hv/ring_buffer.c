@@ -25,6 +25,10 @@
 
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/prefetch.h>
+#include <linux/module.h>
 #include "include/linux/hyperv.h"
 #include <linux/uio.h>
 
@@ -35,6 +39,7 @@ void hv_begin_read(struct hv_ring_buffer_info *rbi)
 	rbi->ring_buffer->interrupt_mask = 1;
 	mb();
 }
+EXPORT_SYMBOL_GPL(hv_begin_read);
 
 u32 hv_end_read(struct hv_ring_buffer_info *rbi)
 {
@@ -53,6 +58,7 @@ u32 hv_end_read(struct hv_ring_buffer_info *rbi)
 
 	return read;
 }
+EXPORT_SYMBOL_GPL(hv_end_read);
 
 /*
  * When we write to the ring buffer, check if the host needs to
@@ -352,12 +358,38 @@ void hv_ringbuffer_get_debuginfo(struct hv_ring_buffer_info *ring_info,
 int hv_ringbuffer_init(struct hv_ring_buffer_info *ring_info,
 		   void *buffer, u32 buflen)
 {
+	u32 page_cnt = buflen >> PAGE_SHIFT;
+	struct page *pages = virt_to_page(buffer);
+	struct page **pages_wraparound;
+	int i;
+
 	if (sizeof(struct hv_ring_buffer) != PAGE_SIZE)
 		return -EINVAL;
 
 	memset(ring_info, 0, sizeof(struct hv_ring_buffer_info));
 
-	ring_info->ring_buffer = (struct hv_ring_buffer *)buffer;
+	/*
+	 * First page holds struct hv_ring_buffer, map the data pages twice
+	 * back to back so that a packet wrapping around the end of the
+	 * ring can be accessed in place by the hv_pkt_iter functions.
+	 */
+	pages_wraparound = kzalloc(sizeof(struct page *) * (page_cnt * 2 - 1),
+				   GFP_KERNEL);
+	if (!pages_wraparound)
+		return -ENOMEM;
+
+	pages_wraparound[0] = pages;
+	for (i = 0; i < 2 * (page_cnt - 1); i++)
+		pages_wraparound[i + 1] = &pages[i % (page_cnt - 1) + 1];
+
+	ring_info->ring_buffer = (struct hv_ring_buffer *)
+		vmap(pages_wraparound, page_cnt * 2 - 1, VM_MAP, PAGE_KERNEL);
+
+	kfree(pages_wraparound);
+
+	if (!ring_info->ring_buffer)
+		return -ENOMEM;
+
 	ring_info->ring_buffer->read_index =
 		ring_info->ring_buffer->write_index = 0;
 
@@ -383,6 +415,9 @@ int hv_ringbuffer_init(struct hv_ring_buffer_info *ring_info,
  */
 void hv_ringbuffer_cleanup(struct hv_ring_buffer_info *ring_info)
 {
+	if (ring_info->ring_buffer)
+		vunmap(ring_info->ring_buffer);
+	ring_info->ring_buffer = NULL;
 }
 
 /*
@@ -557,6 +592,7 @@ int hv_ringbuffer_read(struct hv_ring_buffer_info *inring_info, void *buffer,
 
 	/* Update the read index */
 	hv_set_next_read_location(inring_info, next_read_location);
+	inring_info->priv_read_index = next_read_location;
 
 	spin_unlock_irqrestore(&inring_info->ring_lock, flags);
 
@@ -564,3 +600,93 @@ int hv_ringbuffer_read(struct hv_ring_buffer_info *inring_info, void *buffer,
 
 	return 0;
 }
+
+/*
+ * Determine number of bytes available in ring buffer after
+ * the current iterator (priv_read_index) location.
+ */
+static u32 hv_pkt_iter_avail(const struct hv_ring_buffer_info *rbi)
+{
+	u32 priv_read_loc = rbi->priv_read_index;
+	u32 write_loc = rbi->ring_buffer->write_index;
+
+	if (write_loc >= priv_read_loc)
+		return write_loc - priv_read_loc;
+	else
+		return (rbi->ring_datasize - priv_read_loc) + write_loc;
+}
+
+/*
+ * Get first vmbus packet from ring buffer after read_index
+ *
+ * If ring buffer is empty, returns NULL and no other action needed.
+ * The packet is returned in place; since the ring is double mapped it
+ * is contiguous even when it wraps around.
+ */
+struct vmpacket_descriptor *hv_pkt_iter_first(struct vmbus_channel *channel)
+{
+	struct hv_ring_buffer_info *rbi = &channel->inbound;
+	struct vmpacket_descriptor *desc;
+
+	if (hv_pkt_iter_avail(rbi) < sizeof(struct vmpacket_descriptor))
+		return NULL;
+
+	/* Read the descriptor only after seeing the write index move */
+	rmb();
+
+	desc = hv_get_ring_buffer(rbi) + rbi->priv_read_index;
+	prefetch((char *)desc + (desc->len8 << 3));
+
+	return desc;
+}
+EXPORT_SYMBOL_GPL(hv_pkt_iter_first);
+
+/*
+ * Get next vmbus packet from ring buffer.
+ *
+ * Advances the current location (priv_read_index) and checks for more
+ * data. If the end of the ring buffer is reached, then return NULL.
+ */
+struct vmpacket_descriptor *
+__hv_pkt_iter_next(struct vmbus_channel *channel,
+		   const struct vmpacket_descriptor *desc)
+{
+	struct hv_ring_buffer_info *rbi = &channel->inbound;
+	u32 packetlen = desc->len8 << 3;
+	u32 dsize = rbi->ring_datasize;
+
+	/* bump offset to next potential packet */
+	rbi->priv_read_index += packetlen + VMBUS_PKT_TRAILER;
+	if (rbi->priv_read_index >= dsize)
+		rbi->priv_read_index -= dsize;
+
+	/* more data? */
+	return hv_pkt_iter_first(channel);
+}
+EXPORT_SYMBOL_GPL(__hv_pkt_iter_next);
+
+/*
+ * Update host ring buffer after iterating over packets, and signal the
+ * host if it was blocked waiting for the space we just released.
+ */
+void hv_pkt_iter_close(struct vmbus_channel *channel)
+{
+	struct hv_ring_buffer_info *rbi = &channel->inbound;
+	u32 orig_read_index;
+
+	/*
+	 * Make sure all reads are done before updating the read index since
+	 * the writer may start writing to the read area once the read index
+	 * is updated.
+	 */
+	mb();
+	orig_read_index = rbi->ring_buffer->read_index;
+	rbi->ring_buffer->read_index = rbi->priv_read_index;
+
+	/* Order the read_index update before sampling pending_send_sz */
+	mb();
+
+	if (hv_need_to_signal_on_read(orig_read_index, rbi))
+		vmbus_setevent(channel);
+}
+EXPORT_SYMBOL_GPL(hv_pkt_iter_close);
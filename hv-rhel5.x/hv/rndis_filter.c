@@ -924,6 +924,7 @@ static int rndis_filter_close_device(struct rndis_device *dev)
 static void netvsc_sc_open(struct vmbus_channel *new_sc)
 {
 	struct netvsc_device *nvscdev;
+	struct netvsc_channel *nvchan;
 	u16 chn_index = new_sc->offermsg.offer.sub_channel_index;
 	int ret;
 
@@ -932,12 +933,12 @@ static void netvsc_sc_open(struct vmbus_channel *new_sc)
 	if (chn_index >= nvscdev->num_chn)
 		return;
 
-	set_per_channel_state(new_sc, nvscdev->sub_cb_buf + (chn_index - 1) *
-			      NETVSC_PACKET_SIZE);
+	nvchan = &nvscdev->sub_chan[chn_index - 1];
+	netvsc_chan_poll_init(nvchan, nvscdev, new_sc);
 
 	ret = vmbus_open(new_sc, nvscdev->ring_size * PAGE_SIZE,
 			 nvscdev->ring_size * PAGE_SIZE, NULL, 0,
-			 netvsc_channel_cb, new_sc);
+			 netvsc_channel_cb, nvchan);
 
 	if (ret == 0)
 		nvscdev->chn_table[chn_index] = new_sc;
@@ -1046,9 +1047,9 @@ int rndis_filter_device_add(struct hv_device *dev,
 	if (net_device->num_chn == 1)
 		goto out;
 
-	net_device->sub_cb_buf = vzalloc((net_device->num_chn - 1) *
-					 NETVSC_PACKET_SIZE);
-	if (!net_device->sub_cb_buf) {
+	net_device->sub_chan = vzalloc((net_device->num_chn - 1) *
+				       sizeof(struct netvsc_channel));
+	if (!net_device->sub_chan) {
 		net_device->num_chn = 1;
 		dev_info(&dev->device, "No memory for subchannels.\n");
 		goto out;
@@ -417,6 +417,14 @@ struct storvsc_device {
 	/* Used for vsc/vsp channel reset process */
 	struct storvsc_cmd_request init_request;
 	struct storvsc_cmd_request reset_request;
+	/*
+	 * Opened channels; slot 0 is the primary channel and sub-channels
+	 * follow in the order they were opened. RHEL 5.x binds all channel
+	 * interrupts to the boot cpu, so unlike later releases this table
+	 * is dense and not indexed by target_cpu.
+	 */
+	struct vmbus_channel **stor_chns;
+	u16 num_sc;
 };
 
 struct stor_mem_pools {
@@ -852,6 +860,14 @@ static void handle_sc_creation(struct vmbus_channel *new_sc)
 		   (void *)&props,
 		   sizeof(struct vmstorage_channel_properties),
 		   storvsc_on_channel_callback, new_sc);
+
+	if (new_sc->state == CHANNEL_OPENED_STATE &&
+	    stor_device->num_sc < num_possible_cpus()) {
+		stor_device->stor_chns[stor_device->num_sc + 1] = new_sc;
+		/* Publish the slot before the I/O path can select it */
+		smp_wmb();
+		stor_device->num_sc++;
+	}
 }
 
 static void  handle_multichannel_storage(struct hv_device *device, int max_chns)
@@ -1029,6 +1045,18 @@ static int storvsc_channel_init(struct hv_device *device)
 	 * support multi-channel.
 	 */
 	max_chns = vstor_packet->storage_channel_properties.max_channel_cnt;
+
+	/*
+	 * Allocate state to manage the sub-channels: one slot for the
+	 * primary channel and at most one sub-channel per possible CPU.
+	 */
+	stor_device->stor_chns = kcalloc(num_possible_cpus() + 1,
+					 sizeof(void *), GFP_KERNEL);
+	if (stor_device->stor_chns == NULL)
+		return -ENOMEM;
+
+	stor_device->stor_chns[0] = device->channel;
+
 	if ((vmbus_proto_version != VERSION_WIN7) &&
 	   (vmbus_proto_version != VERSION_WS2008))  {
 		if (vstor_packet->storage_channel_properties.flags &
@@ -1328,13 +1356,9 @@ static void storvsc_on_receive(struct hv_device *device,
 static void storvsc_on_channel_callback(void *context)
 {
 	struct vmbus_channel *channel = (struct vmbus_channel *)context;
+	const struct vmpacket_descriptor *desc;
 	struct hv_device *device;
 	struct storvsc_device *stor_device;
-	u32 bytes_recvd;
-	u64 request_id;
-	unsigned char packet[ALIGN(sizeof(struct vstor_packet), 8)];
-	struct storvsc_cmd_request *request;
-	int ret;
 
 	if (channel->primary_channel != NULL)
 		device = channel->primary_channel->device_obj;
@@ -1345,34 +1369,22 @@ static void storvsc_on_channel_callback(void *context)
 	if (!stor_device)
 		return;
 
-	do {
-		ret = vmbus_recvpacket(channel, packet,
-				       ALIGN((sizeof(struct vstor_packet) -
-					     vmscsi_size_delta), 8),
-				       &bytes_recvd, &request_id);
-		if (ret == 0 && bytes_recvd > 0) {
-
-			request = (struct storvsc_cmd_request *)
-					(unsigned long)request_id;
-
-			if ((request == &stor_device->init_request) ||
-			    (request == &stor_device->reset_request)) {
-
-				memcpy(&request->vstor_packet, packet,
-				       (sizeof(struct vstor_packet) -
-					vmscsi_size_delta));
-				complete(&request->wait_event);
-			} else {
-				storvsc_on_receive(device,
-						(struct vstor_packet *)packet,
-						request);
-			}
+	foreach_vmbus_pkt(desc, channel) {
+		void *packet = hv_pkt_data(desc);
+		struct storvsc_cmd_request *request;
+
+		request = (struct storvsc_cmd_request *)
+			((unsigned long)desc->trans_id);
+
+		if (request == &stor_device->init_request ||
+		    request == &stor_device->reset_request) {
+			memcpy(&request->vstor_packet, packet,
+			       (sizeof(struct vstor_packet) - vmscsi_size_delta));
+			complete(&request->wait_event);
 		} else {
-			break;
+			storvsc_on_receive(device, packet, request);
 		}
-	} while (1);
-
-	return;
+	}
 }
 
 static int storvsc_connect_to_vsp(struct hv_device *device, u32 ring_size)
@@ -1430,32 +1442,33 @@ static int storvsc_dev_remove(struct hv_device *device)
 	/* Close the channel */
 	vmbus_close(device->channel);
 
+	kfree(stor_device->stor_chns);
 	kfree(stor_device);
 	return 0;
 }
 
-static struct vmbus_channel *get_og_chn(struct vmbus_channel *primary,
-					int chn_num)
+static struct vmbus_channel *get_og_chn(struct storvsc_device *stor_device,
+					int cpu)
 {
-	int next_channel = 1;
-	struct list_head *cur, *tmp;
-	struct vmbus_channel *cur_channel;
-
-	if ((chn_num == 0) || (list_empty(&primary->sc_list)))
-		return primary;
+	u16 num_sc = stor_device->num_sc;
+	struct vmbus_channel *channel;
 
+	if (num_sc == 0)
+		return stor_device->device->channel;
 
-	list_for_each_safe(cur, tmp, &primary->sc_list) {
-		cur_channel = list_entry(cur, struct vmbus_channel, sc_list);
-		if (cur_channel->state != CHANNEL_OPENED_STATE)
-			continue;
+	/* Pairs with the smp_wmb() in handle_sc_creation() */
+	smp_rmb();
 
-		if (next_channel == chn_num)
-			return cur_channel;
-		next_channel++;
-	}
+	/*
+	 * Distribute I/O evenly over the opened channels; the mapping
+	 * of a submitting CPU to its channel is stable once all the
+	 * sub-channels have been opened.
+	 */
+	channel = stor_device->stor_chns[cpu % (num_sc + 1)];
+	if (channel == NULL || channel->state != CHANNEL_OPENED_STATE)
+		return stor_device->device->channel;
 
-	return primary;
+	return channel;
 }
 
 static int storvsc_do_io(struct hv_device *device,
@@ -1465,7 +1478,6 @@ static int storvsc_do_io(struct hv_device *device,
 	struct vstor_packet *vstor_packet;
 	struct vmbus_channel *outgoing_channel;
 	int ret = 0;
-	int chn_num;
 
 	vstor_packet = &request->vstor_packet;
 	stor_device = get_out_stor_device(device);
@@ -1480,8 +1492,7 @@ static int storvsc_do_io(struct hv_device *device,
 	 * We will base the request based on the CPU that is presenting
 	 * the I/O request.
 	 */
-	chn_num = smp_processor_id() % (device->channel->num_sc + 1);
-	outgoing_channel = get_og_chn(device->channel, chn_num);
+	outgoing_channel = get_og_chn(stor_device, smp_processor_id());
 
 	vstor_packet->flags |= REQUEST_COMPLETION_FLAG;
 
@@ -2107,6 +2118,7 @@ err_out2:
 	goto err_out0;
 
 err_out1:
+	kfree(stor_device->stor_chns);
 	kfree(stor_device);
 
 err_out0:
@@ -0,0 +1,155 @@
+/*
+ * Hyper-V specific APIC code.
+ *
+ * Copyright (C) 2018, Microsoft, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE, GOOD TITLE or
+ * NON INFRINGEMENT.  See the GNU General Public License for more
+ * details.
+ *
+ */
+
+#define pr_fmt(fmt)  "Hyper-V: " fmt
+
+#include <linux/types.h>
+#include <linux/cpumask.h>
+#include <linux/smp.h>
+#include <asm/apic.h>
+#include <lis/asm/hyperv.h>
+#include <lis/asm/mshyperv.h>
+
+#ifdef CONFIG_X86_64
+
+/* The APIC callbacks we replace; used as fallback and restored on unload */
+static struct apic orig_apic;
+static bool hv_apic_installed;
+
+/*
+ * Send an IPI to every CPU in @mask, optionally skipping the current one,
+ * with a single HvCallSendSyntheticClusterIpi fast hypercall. Returns
+ * false if the caller has to fall back to the emulated APIC path.
+ */
+static bool __send_ipi_mask(const struct cpumask *mask, int vector,
+			    bool exclude_self)
+{
+	int cur_cpu, vcpu, this_cpu = smp_processor_id();
+	u64 cpu_mask = 0;
+	int nr_vps = 0;
+	u64 status;
+
+	if ((vector < HV_IPI_LOW_VECTOR) || (vector > HV_IPI_HIGH_VECTOR))
+		return false;
+
+	for_each_cpu(cur_cpu, mask) {
+		if (exclude_self && cur_cpu == this_cpu)
+			continue;
+
+		vcpu = hv_cpu_number_to_vp_number(cur_cpu);
+		/*
+		 * The non-EX hypercall takes a 64 bit VP mask; unknown VP
+		 * indices and VPs beyond 63 take the APIC path.
+		 */
+		if (vcpu < 0 || vcpu >= 64)
+			return false;
+
+		__set_bit(vcpu, (unsigned long *)&cpu_mask);
+		nr_vps++;
+	}
+
+	if (!nr_vps)
+		return true;
+
+	status = hv_do_fast_hypercall16(HVCALL_SEND_IPI, vector, cpu_mask);
+	return (status & HV_HYPERCALL_RESULT_MASK) == HV_STATUS_SUCCESS;
+}
+
+static void hv_send_ipi_mask(const struct cpumask *mask, int vector)
+{
+	if (!__send_ipi_mask(mask, vector, false))
+		orig_apic.send_IPI_mask(mask, vector);
+}
+
+static void hv_send_ipi_mask_allbutself(const struct cpumask *mask, int vector)
+{
+	if (!__send_ipi_mask(mask, vector, true))
+		orig_apic.send_IPI_mask_allbutself(mask, vector);
+}
+
+static void hv_send_ipi_allbutself(int vector)
+{
+	if (!__send_ipi_mask(cpu_online_mask, vector, true))
+		orig_apic.send_IPI_allbutself(vector);
+}
+
+static void hv_send_ipi_all(int vector)
+{
+	if (!__send_ipi_mask(cpu_online_mask, vector, false))
+		orig_apic.send_IPI_all(vector);
+}
+
+static void hv_send_ipi_self(int vector)
+{
+	if (!__send_ipi_mask(cpumask_of(smp_processor_id()), vector, false))
+		orig_apic.send_IPI_self(vector);
+}
+
+/*
+ * Upstream does this from hyperv_init() at early boot, before any IPI
+ * is sent. We get here from hv_acpi_init() once VMBus init has succeeded,
+ * so a failed module load never leaves apic pointing into freed text.
+ * hv_vp_index[] entries are filled in per CPU by hv_synic_init(); CPUs
+ * without one take the original APIC callbacks.
+ */
+void hv_apic_init(void)
+{
+	if (!(ms_hyperv_ext.hints & HV_X64_CLUSTER_IPI_RECOMMENDED))
+		return;
+
+	if (!hv_hypercall_pg || !hv_vp_index)
+		return;
+
+	pr_info("Using IPI hypercalls\n");
+
+	orig_apic = *apic;
+	hv_apic_installed = true;
+
+	apic->send_IPI_mask = hv_send_ipi_mask;
+	apic->send_IPI_mask_allbutself = hv_send_ipi_mask_allbutself;
+	apic->send_IPI_allbutself = hv_send_ipi_allbutself;
+	apic->send_IPI_all = hv_send_ipi_all;
+	apic->send_IPI_self = hv_send_ipi_self;
+}
+
+void hv_apic_cleanup(void)
+{
+	if (!hv_apic_installed)
+		return;
+
+	apic->send_IPI_mask = orig_apic.send_IPI_mask;
+	apic->send_IPI_mask_allbutself = orig_apic.send_IPI_mask_allbutself;
+	apic->send_IPI_allbutself = orig_apic.send_IPI_allbutself;
+	apic->send_IPI_all = orig_apic.send_IPI_all;
+	apic->send_IPI_self = orig_apic.send_IPI_self;
+	hv_apic_installed = false;
+
+	/* Wait for senders still running our callbacks */
+	synchronize_sched();
+}
+
+#else
+
+void hv_apic_init(void)
+{
+}
+
+void hv_apic_cleanup(void)
+{
+}
+
+#endif /* CONFIG_X86_64 */
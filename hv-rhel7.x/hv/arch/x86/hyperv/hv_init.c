@@ -26,6 +26,8 @@
 #include <linux/mm.h>
 #include <linux/clockchips.h>
 #include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
 
 
 #ifdef CONFIG_X86_64
@@ -34,39 +36,11 @@ static struct ms_hyperv_tsc_page *tsc_pg;
 
 static u64 read_hv_clock_tsc(struct clocksource *arg)
 {
-	u64 current_tick;
+	u64 current_tick = hv_read_tsc_page(tsc_pg);
+
+	if (current_tick == U64_MAX)
+		rdmsrl(HV_X64_MSR_TIME_REF_COUNT, current_tick);
 
-	if (tsc_pg->tsc_sequence != 0) {
-		/*
-		 * Use the tsc page to compute the value.
-		 */
-
-		while (1) {
-			u64 tmp;
-			u32 sequence = tsc_pg->tsc_sequence;
-			u64 cur_tsc;
-			u64 scale = tsc_pg->tsc_scale;
-			s64 offset = tsc_pg->tsc_offset;
-
-			rdtscll(cur_tsc);
-			/* current_tick = ((cur_tsc *scale) >> 64) + offset */
-			asm("mulq %3"
-				: "=d" (current_tick), "=a" (tmp)
-				: "a" (cur_tsc), "r" (scale));
-
-			current_tick += offset;
-			if (tsc_pg->tsc_sequence == sequence)
-				return current_tick;
-
-			if (tsc_pg->tsc_sequence != 0)
-				continue;
-			/*
-			 * Fallback using MSR method.
-			 */
-			break;
-		}
-	}
-	rdmsrl(HV_X64_MSR_TIME_REF_COUNT, current_tick);
 	return current_tick;
 }
 
@@ -77,6 +51,76 @@ static struct clocksource hyperv_cs_tsc = {
 	.mask		= CLOCKSOURCE_MASK(64),
 	.flags		= CLOCK_SOURCE_IS_CONTINUOUS,
 };
+
+/*
+ * The vDSO is part of the core kernel image and cannot be taught about
+ * our clocksource from a module. Instead, let userspace map the reference
+ * TSC page read-only and run the same sequence/scale/offset protocol
+ * (see tools/hv_tsc_page.h), which avoids a syscall per timestamp.
+ */
+static int hv_tsc_page_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (!tsc_pg)
+		return -ENODEV;
+
+	if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC))
+		return -EPERM;
+
+	vma->vm_flags &= ~(VM_MAYWRITE | VM_MAYEXEC);
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	return remap_pfn_range(vma, vma->vm_start, vmalloc_to_pfn(tsc_pg),
+			       PAGE_SIZE, PAGE_READONLY);
+}
+
+static const struct file_operations hv_tsc_page_fops = {
+	.owner	= THIS_MODULE,
+	.mmap	= hv_tsc_page_mmap,
+};
+
+static struct miscdevice hv_tsc_page_dev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "hv_tsc_page",
+	.fops	= &hv_tsc_page_fops,
+	.mode	= 0444,
+};
+
+static bool hv_tsc_page_dev_registered;
+
+/*
+ * Called once VMBus init can no longer fail, so that a failed module
+ * load never leaves the device registered with our fops.
+ */
+void hyperv_add_tsc_page_dev(void)
+{
+	if (!tsc_pg || hv_tsc_page_dev_registered)
+		return;
+
+	if (misc_register(&hv_tsc_page_dev))
+		pr_warn("Hyper-V: unable to register hv_tsc_page device\n");
+	else
+		hv_tsc_page_dev_registered = true;
+}
+
+void hyperv_remove_tsc_page_dev(void)
+{
+	if (!hv_tsc_page_dev_registered)
+		return;
+
+	misc_deregister(&hv_tsc_page_dev);
+	hv_tsc_page_dev_registered = false;
+}
+#else
+void hyperv_add_tsc_page_dev(void)
+{
+}
+
+void hyperv_remove_tsc_page_dev(void)
+{
+}
 #endif
 
 static u64 read_hv_clock_msr(struct clocksource *arg)
@@ -136,6 +180,7 @@ void hyperv_init(void)
 {
 	u64 guest_id, required_msrs;
 	union hv_x64_msr_hypercall_contents hypercall_msr;
+	int i;
 
 	if (x86_hyper != &x86_hyper_ms_hyperv)
 		return;
@@ -152,7 +197,13 @@ void hyperv_init(void)
 				    GFP_KERNEL);
 	if (!hv_vp_index)
 		return;
-	/* We'll initialize hv_vp_index[] later in hv_synic_init. */
+	/*
+	 * We'll initialize hv_vp_index[] later in hv_synic_init. Until then
+	 * mark every entry invalid so the IPI hypercall path falls back to
+	 * the APIC.
+	 */
+	for (i = 0; i < num_possible_cpus(); i++)
+		hv_vp_index[i] = U32_MAX;
 
 	/*
 	 * Setup the hypercall page and enable hypercalls.
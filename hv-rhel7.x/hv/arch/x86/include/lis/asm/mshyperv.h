@@ -73,6 +73,54 @@ struct ms_hyperv_tsc_page {
 	u64 reserved2[509];
 };
 
+#ifdef CONFIG_X86_64
+/*
+ * Read the reference time from the TSC page, in 100ns units. Returns
+ * U64_MAX when the page is not valid (sequence 0) and the caller has to
+ * fall back to HV_X64_MSR_TIME_REF_COUNT. The same protocol is mirrored
+ * for userspace in tools/hv_tsc_page.h; keep the two in sync.
+ */
+static inline u64 hv_read_tsc_page(const struct ms_hyperv_tsc_page *tsc_pg)
+{
+	u64 scale, cur_tsc, current_tick, tmp;
+	s64 offset;
+	u32 sequence;
+
+	if (!tsc_pg)
+		return U64_MAX;
+
+	do {
+		sequence = tsc_pg->tsc_sequence;
+		if (sequence == 0)
+			return U64_MAX;
+		/*
+		 * Make sure we read sequence before we read other values from
+		 * the TSC page.
+		 */
+		smp_rmb();
+
+		scale = tsc_pg->tsc_scale;
+		offset = tsc_pg->tsc_offset;
+		rdtscll(cur_tsc);
+
+		/* current_tick = ((cur_tsc * scale) >> 64) + offset */
+		asm("mulq %3"
+			: "=d" (current_tick), "=a" (tmp)
+			: "a" (cur_tsc), "r" (scale));
+		current_tick += offset;
+
+		/*
+		 * Make sure we read sequence after we read all other values
+		 * from the TSC page.
+		 */
+		smp_rmb();
+
+	} while (tsc_pg->tsc_sequence != sequence);
+
+	return current_tick;
+}
+#endif
+
 /*
  * The guest OS needs to register the guest ID with the hypervisor.
  * The guest ID is a 64 bit entity and the structure of this ID is
@@ -255,6 +303,76 @@ static inline u64 hv_do_fast_hypercall8(u16 code, u64 input1)
 		return hv_status;
 }
 
+/* Fast hypercall with 16 bytes of input and no output */
+static inline u64 hv_do_fast_hypercall16(u16 code, u64 input1, u64 input2)
+{
+	u64 hv_status, control = (u64)code | HV_HYPERCALL_FAST_BIT;
+
+#ifdef CONFIG_X86_64
+	{
+		__asm__ __volatile__("mov %4, %%r8\n"
+				     "call *%5"
+				     : "=a" (hv_status), ASM_CALL_CONSTRAINT,
+				       "+c" (control), "+d" (input1)
+				     : "r" (input2), "m" (hv_hypercall_pg)
+				     : "cc", "r8", "r9", "r10", "r11");
+	}
+#else
+	{
+		u32 input1_hi = upper_32_bits(input1);
+		u32 input1_lo = lower_32_bits(input1);
+		u32 input2_hi = upper_32_bits(input2);
+		u32 input2_lo = lower_32_bits(input2);
+
+		__asm__ __volatile__ ("call *%7"
+				      : "=A"(hv_status),
+					"+c"(input1_lo), ASM_CALL_CONSTRAINT
+				      :	"A" (control), "b" (input1_hi),
+					"D"(input2_hi), "S"(input2_lo),
+					"m" (hv_hypercall_pg)
+				      : "cc");
+	}
+#endif
+	return hv_status;
+}
+
+#ifdef CONFIG_X86_64
+/*
+ * Size of the input block of an XMM fast hypercall: RDX and R8 carry the
+ * first 16 bytes, XMM0-XMM5 the remaining 96.
+ */
+#define HV_HYPERCALL_XMM_INPUT_SIZE	(2 * sizeof(u64) + 6 * 16)
+
+/*
+ * Fast hypercall with up to HV_HYPERCALL_XMM_INPUT_SIZE bytes of input
+ * passed in registers and no output. @input must point to a buffer of
+ * that full size. The caller must check HV_X64_HYPERCALL_PARAMS_XMM_AVAILABLE
+ * and hold kernel_fpu_begin() across the call.
+ */
+static inline u64 hv_do_xmm_fast_hypercall(u16 code, const void *input)
+{
+	const u64 *in = input;
+	u64 hv_status, control = (u64)code | HV_HYPERCALL_FAST_BIT;
+	u64 input1 = in[0];
+
+	__asm__ __volatile__("movdqu 0x10(%[in]), %%xmm0\n"
+			     "movdqu 0x20(%[in]), %%xmm1\n"
+			     "movdqu 0x30(%[in]), %%xmm2\n"
+			     "movdqu 0x40(%[in]), %%xmm3\n"
+			     "movdqu 0x50(%[in]), %%xmm4\n"
+			     "movdqu 0x60(%[in]), %%xmm5\n"
+			     "mov %[in2], %%r8\n"
+			     "call *%[pg]"
+			     : "=a" (hv_status), ASM_CALL_CONSTRAINT,
+			       "+c" (control), "+d" (input1)
+			     : [in] "r" (in), [in2] "r" (in[1]),
+			       [pg] "m" (hv_hypercall_pg)
+			     : "cc", "memory", "r8", "r9", "r10", "r11",
+			       "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5");
+	return hv_status;
+}
+#endif
+
 /*
  * Rep hypercalls. Callers of this functions are supposed to ensure that
  * rep_count and varhead_size comply with Hyper-V hypercall definition.
@@ -317,6 +435,13 @@ int hv_cpu_init(unsigned int cpu);
 bool hv_is_hypercall_page_setup(void);
 void hyperv_cleanup(void);
 void hv_print_host_info(void);
+void hyperv_add_tsc_page_dev(void);
+void hyperv_remove_tsc_page_dev(void);
+void hv_apic_init(void);
+void hv_apic_cleanup(void);
+#ifdef CONFIG_X86_64
+struct ms_hyperv_tsc_page *hv_get_tsc_page(void);
+#endif
 #endif
 
 #define hv_get_synint_state(int_num, val) rdmsrl(int_num, val)
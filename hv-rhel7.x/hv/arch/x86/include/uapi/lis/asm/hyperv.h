@@ -150,10 +150,15 @@
  */
 #define HV_X64_DEPRECATING_AEOI_RECOMMENDED	(1 << 9)
 
+/*
+ * Recommend using cluster IPI hypercalls.
+ */
+#define HV_X64_CLUSTER_IPI_RECOMMENDED		(1 << 10)
+
 /*
  * HV_VP_SET available
  */
-#define HV_X64_EX_PROCESSOR_MASKS_RECOMMENDED	(1 < 11)
+#define HV_X64_EX_PROCESSOR_MASKS_RECOMMENDED	(1 << 11)
 
 
 /*
@@ -238,6 +243,7 @@
 
 /* Declare the various hypercall operations. */
 #define HV_X64_HV_NOTIFY_LONG_SPIN_WAIT		0x0008
+#define HVCALL_SEND_IPI				0x000b
 #define HVCALL_POST_MESSAGE			0x005c
 #define HVCALL_SIGNAL_EVENT			0x005d
 
@@ -249,6 +255,10 @@
 #define HV_X64_MSR_TSC_REFERENCE_ENABLE		0x00000001
 #define HV_X64_MSR_TSC_REFERENCE_ADDRESS_SHIFT	12
 
+/* Valid vector range for HVCALL_SEND_IPI */
+#define HV_IPI_LOW_VECTOR			0x10
+#define HV_IPI_HIGH_VECTOR			0xff
+
 #define HV_PROCESSOR_POWER_STATE_C0		0
 #define HV_PROCESSOR_POWER_STATE_C1		1
 #define HV_PROCESSOR_POWER_STATE_C2		2
@@ -45,6 +45,8 @@ void vmbus_setevent(struct vmbus_channel *channel)
 
 	trace_vmbus_setevent(channel);
 
+	++channel->sig_events;
+
 	/*
 	 * For channels marked as in "low latency" mode
 	 * bypass the monitor page mechanism.
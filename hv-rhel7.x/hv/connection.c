@@ -337,7 +337,9 @@ void vmbus_on_event(unsigned long data)
 		if (unlikely(callback_fn == NULL))
 			return;
 
+		trace_vmbus_chan_cb_enter(channel);
 		(*callback_fn)(channel->channel_callback_context);
+		trace_vmbus_chan_cb_exit(channel);
 
 		if (channel->callback_mode != HV_CALL_BATCHED)
 			return;
@@ -33,6 +33,9 @@
 #include <lis/asm/mshyperv.h>
 #include "hyperv_vmbus.h"
 #include <asm/msr.h>
+#include <asm/i387.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
 
 
 /* The one and only */
@@ -74,22 +77,66 @@ int hv_init(void)
 	return 0;
 }
 
+#ifdef CONFIG_X86_64
+/* Largest payload that fits an XMM fast HVCALL_POST_MESSAGE */
+#define HV_POST_MESSAGE_FAST_PAYLOAD \
+	(HV_HYPERCALL_XMM_INPUT_SIZE - \
+	 offsetof(struct hv_input_post_message, payload))
+
 /*
- * hv_post_message - Post a message using the hypervisor message IPC.
- *
- * This involves a hypercall.
+ * Post a small message with the input block passed in registers, which
+ * saves copying it into post_msg_page and the host mapping that page.
  */
-int hv_post_message(union hv_connection_id connection_id,
-		  enum hv_message_type message_type,
-		  void *payload, size_t payload_size)
+static u64 hv_post_message_fast(union hv_connection_id connection_id,
+				enum hv_message_type message_type,
+				void *payload, size_t payload_size)
+{
+	u64 input[HV_HYPERCALL_XMM_INPUT_SIZE / sizeof(u64)];
+	struct hv_input_post_message *msg = (void *)input;
+	u64 status;
+
+	memset(input, 0, sizeof(input));
+	msg->connectionid = connection_id;
+	msg->message_type = message_type;
+	msg->payload_size = payload_size;
+	memcpy((void *)msg->payload, payload, payload_size);
+
+	kernel_fpu_begin();
+	status = hv_do_xmm_fast_hypercall(HVCALL_POST_MESSAGE, input);
+	kernel_fpu_end();
+
+	return status;
+}
+
+static bool hv_post_message_use_fast(size_t payload_size)
+{
+	return payload_size <= HV_POST_MESSAGE_FAST_PAYLOAD &&
+		(ms_hyperv_ext.misc_features &
+		 HV_X64_HYPERCALL_PARAMS_XMM_AVAILABLE) &&
+		irq_fpu_usable();
+}
+#else
+static u64 hv_post_message_fast(union hv_connection_id connection_id,
+				enum hv_message_type message_type,
+				void *payload, size_t payload_size)
+{
+	return U64_MAX;
+}
+
+static bool hv_post_message_use_fast(size_t payload_size)
+{
+	return false;
+}
+#endif
+
+static u64 hv_post_message_slow(union hv_connection_id connection_id,
+				enum hv_message_type message_type,
+				void *payload, size_t payload_size)
 {
 	struct hv_input_post_message *aligned_msg;
 	struct hv_per_cpu_context *hv_cpu;
 	u64 status;
 
-	if (payload_size > HV_MESSAGE_PAYLOAD_BYTE_COUNT)
-		return -EMSGSIZE;
-
 	hv_cpu = get_cpu_ptr(hv_context.cpu_context);
 	aligned_msg = hv_cpu->post_msg_page;
 	aligned_msg->connectionid = connection_id;
@@ -106,9 +153,153 @@ int hv_post_message(union hv_connection_id connection_id,
 	 */
 	put_cpu_ptr(hv_cpu);
 
+	return status;
+}
+
+/*
+ * Per-path accounting of real HVCALL_POST_MESSAGE calls, to compare the
+ * cost of the two variants on live VMBus traffic. Writing 1 to
+ * /sys/module/hv_vmbus/parameters/post_msg_stats clears the counters and
+ * starts counting, writing 0 stops; reading it reports calls, failed
+ * calls and the average cost per call for each path.
+ */
+struct hv_post_msg_stat {
+	atomic64_t calls;
+	atomic64_t failures;
+	atomic64_t ns;
+};
+
+static bool post_msg_stats;
+static struct hv_post_msg_stat post_msg_stat[2];	/* [fast] */
+
+/* Cleared when the host turns down the XMM form of the call */
+static bool post_msg_fast_ok = true;
+
+static u64 hv_post_message_path(bool fast,
+				union hv_connection_id connection_id,
+				enum hv_message_type message_type,
+				void *payload, size_t payload_size)
+{
+	struct hv_post_msg_stat *st = &post_msg_stat[fast];
+	bool account = ACCESS_ONCE(post_msg_stats);
+	u64 start = 0, status;
+
+	if (account)
+		start = ktime_to_ns(ktime_get());
+
+	if (fast)
+		status = hv_post_message_fast(connection_id, message_type,
+					      payload, payload_size);
+	else
+		status = hv_post_message_slow(connection_id, message_type,
+					      payload, payload_size);
+
+	if (account) {
+		atomic64_add(ktime_to_ns(ktime_get()) - start, &st->ns);
+		atomic64_inc(&st->calls);
+		if ((status & HV_HYPERCALL_RESULT_MASK) != HV_STATUS_SUCCESS)
+			atomic64_inc(&st->failures);
+	}
+
+	return status;
+}
+
+/*
+ * hv_post_message - Post a message using the hypervisor message IPC.
+ *
+ * This involves a hypercall.
+ */
+int hv_post_message(union hv_connection_id connection_id,
+		  enum hv_message_type message_type,
+		  void *payload, size_t payload_size)
+{
+	u64 status, fast_status;
+
+	if (payload_size > HV_MESSAGE_PAYLOAD_BYTE_COUNT)
+		return -EMSGSIZE;
+
+	if (ACCESS_ONCE(post_msg_fast_ok) &&
+	    hv_post_message_use_fast(payload_size)) {
+		fast_status = hv_post_message_path(true, connection_id,
+						   message_type, payload,
+						   payload_size);
+		fast_status &= HV_HYPERCALL_RESULT_MASK;
+		if (fast_status == HV_STATUS_SUCCESS)
+			return 0;
+
+		/*
+		 * Whatever the reason, retry through post_msg_page. If that
+		 * goes through where the XMM form did not, and the host was
+		 * not merely out of buffers, it does not take the XMM form.
+		 */
+		status = hv_post_message_path(false, connection_id,
+					      message_type, payload,
+					      payload_size);
+		if ((status & HV_HYPERCALL_RESULT_MASK) == HV_STATUS_SUCCESS &&
+		    fast_status != HV_STATUS_INSUFFICIENT_BUFFERS) {
+			pr_info("xmm fast post message rejected (0x%llx), "
+				"using post_msg_page\n", fast_status);
+			post_msg_fast_ok = false;
+		}
+	} else {
+		status = hv_post_message_path(false, connection_id,
+					      message_type, payload,
+					      payload_size);
+	}
+
 	return status & 0xFFFF;
 }
 
+static int hv_post_msg_stats_set(const char *val,
+				 const struct kernel_param *kp)
+{
+	bool on;
+	int i, ret;
+
+	ret = strtobool(val, &on);
+	if (ret)
+		return ret;
+
+	if (on) {
+		for (i = 0; i < ARRAY_SIZE(post_msg_stat); i++) {
+			atomic64_set(&post_msg_stat[i].calls, 0);
+			atomic64_set(&post_msg_stat[i].failures, 0);
+			atomic64_set(&post_msg_stat[i].ns, 0);
+		}
+	}
+
+	post_msg_stats = on;
+	return 0;
+}
+
+static int hv_post_msg_stats_get(char *buffer, const struct kernel_param *kp)
+{
+	static const char * const names[] = { "post_msg_page", "xmm_fast" };
+	int i, len = 0;
+
+	len += sprintf(buffer + len, "%s\n", post_msg_stats ? "on" : "off");
+	for (i = 0; i < ARRAY_SIZE(post_msg_stat); i++) {
+		u64 calls = atomic64_read(&post_msg_stat[i].calls);
+		u64 ns = atomic64_read(&post_msg_stat[i].ns);
+
+		len += sprintf(buffer + len,
+			       "%s: calls %llu failed %llu avg %llu ns\n",
+			       names[i], calls,
+			       (u64)atomic64_read(&post_msg_stat[i].failures),
+			       calls ? div64_u64(ns, calls) : 0);
+	}
+
+	return len;
+}
+
+static const struct kernel_param_ops post_msg_stats_ops = {
+	.set = hv_post_msg_stats_set,
+	.get = hv_post_msg_stats_get,
+};
+module_param_cb(post_msg_stats, &post_msg_stats_ops, &post_msg_stats, 0644);
+MODULE_PARM_DESC(post_msg_stats,
+		 "Account the cost of each post message hypercall variant");
+
 static int hv_ce_set_next_event(unsigned long delta,
 				struct clock_event_device *evt)
 {
@@ -133,6 +324,7 @@ static void hv_ce_setmode(enum clock_event_mode mode,
 		break;
 
 	case CLOCK_EVT_MODE_ONESHOT:
+		timer_cfg.as_uint64 = 0;
 		timer_cfg.enable = 1;
 		timer_cfg.auto_enable = 1;
 		timer_cfg.sintx = VMBUS_MESSAGE_SINT;
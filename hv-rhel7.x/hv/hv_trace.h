@@ -317,6 +317,21 @@ DEFINE_EVENT(vmbus_channel, vmbus_on_event,
 	    TP_ARGS(channel)
 );
 
+/*
+ * Entry and exit of a channel's onchannel_callback, from the ISR or the
+ * channel tasklet. Like the other vmbus_channel events these are a
+ * stable interface; the argument is the channel being serviced.
+ */
+DEFINE_EVENT(vmbus_channel, vmbus_chan_cb_enter,
+	    TP_PROTO(const struct vmbus_channel *channel),
+	    TP_ARGS(channel)
+);
+
+DEFINE_EVENT(vmbus_channel, vmbus_chan_cb_exit,
+	    TP_PROTO(const struct vmbus_channel *channel),
+	    TP_ARGS(channel)
+);
+
 #undef TRACE_INCLUDE_PATH
 #define TRACE_INCLUDE_PATH .
 #undef TRACE_INCLUDE_FILE
@@ -145,6 +145,7 @@ struct hv_netvsc_packet {
 	u32 send_buf_index;
 	u32 total_data_buflen;
 	void *send_completion_ctx;
+	u64 send_time; /* ns, 0 unless queue_hist is enabled */
 };
 
 struct netvsc_device_info {
@@ -165,16 +166,20 @@ enum rndis_device_state {
 
 #define NETVSC_HASH_KEYLEN 40
 
+/* Control requests that may be in flight at once; must be a power of 2 */
+#define RNDIS_MAX_REQS 32
+
 struct rndis_device {
 	struct net_device *ndev;
 
 	enum rndis_device_state state;
 	atomic_t new_req_id;
 
-	spinlock_t request_lock;
-	struct list_head req_list;
+	/* Outstanding control requests, slot is req_id % RNDIS_MAX_REQS */
+	struct rndis_request *req_table[RNDIS_MAX_REQS];
 
 	struct work_struct mcast_work;
+	u32 mcast_max;		/* host multicast list size, 0 if none */
 
 	bool link_state;        /* 0 - link up, 1 - link down */
 
@@ -190,6 +195,7 @@ struct netvsc_device;
 struct net_device_context;
 
 extern u32 netvsc_ring_bytes;
+extern bool queue_hist;
 
 #if (RHEL_RELEASE_CODE == RHEL_RELEASE_VERSION(7,0))
 extern u32 netvsc_ring_reciprocal;
@@ -226,6 +232,7 @@ struct netvsc_device *rndis_filter_device_add(struct hv_device *dev,
 void rndis_filter_update(struct netvsc_device *nvdev);
 void rndis_filter_device_remove(struct hv_device *dev,
 				struct netvsc_device *nvdev);
+void netvsc_arfs_setup(struct net_device *net, struct netvsc_device *nvdev);
 int rndis_filter_set_rss_param(struct rndis_device *rdev,
 			       const u8 *key);
 int rndis_filter_receive(struct net_device *ndev,
@@ -706,6 +713,7 @@ struct netvsc_stats {
 
 struct netvsc_ethtool_stats {
 	unsigned long tx_scattered;
+	unsigned long tx_compacted;
 	unsigned long tx_no_memory;
 	unsigned long tx_no_space;
 	unsigned long tx_too_big;
@@ -715,6 +723,29 @@ struct netvsc_ethtool_stats {
 	unsigned long rx_no_memory;
 	unsigned long stop_queue;
 	unsigned long wake_queue;
+	unsigned long rx_ntuple_steered;
+	unsigned long rx_ntuple_dropped;
+	unsigned long rx_arfs_updates;
+};
+
+/*
+ * ethtool -N flow steering rules. The table is replaced as a whole
+ * under RTNL and read under RCU in the receive path; rules are kept
+ * sorted by location, the first match wins.
+ */
+#define NETVSC_NTUPLE_MAX	32
+#define NETVSC_NTUPLE_DROP	0xffff
+
+struct netvsc_ntuple_rule {
+	struct ethtool_rx_flow_spec fs;
+	u8 proto;
+	u16 queue;	/* or NETVSC_NTUPLE_DROP */
+};
+
+struct netvsc_ntuple_table {
+	struct rcu_head rcu;
+	u32 cnt;
+	struct netvsc_ntuple_rule rules[];
 };
 
 struct netvsc_vf_pcpu_stats {
@@ -757,7 +788,8 @@ struct net_device_context {
 	bool udp6_l4_hash;
 	u8 duplex;
 	u32 speed;
-	struct netvsc_ethtool_stats eth_stats;
+	struct netvsc_ethtool_stats __percpu *eth_stats;
+	struct netvsc_ntuple_table __rcu *ntuple;
 
 	/* State to manage the associated VF interface. */
 	struct net_device __rcu *vf_netdev;
@@ -768,6 +800,34 @@ struct net_device_context {
 	u32 vf_alloc;
 	/* Serial number of the VF to team with */
 	u32 vf_serial;
+
+#ifdef CONFIG_RFS_ACCEL
+	/* aRFS indirection table updates waiting to be sent to the host */
+	struct delayed_work arfs_work;
+	spinlock_t arfs_lock;
+	DECLARE_BITMAP(arfs_pending, ITAB_NUM);
+	u16 arfs_queue[ITAB_NUM];
+	unsigned long arfs_last;
+#endif
+};
+
+/*
+ * Per queue histograms, updated only when the queue_hist module
+ * parameter is set:
+ *   tx_lat	- send to completion latency, log2 usec (0, 1, 2, 4 .. 1024+)
+ *   poll_batch	- packets handled per netvsc_poll pass, log2 (0, 1, 2 .. 64+)
+ *   ring_used	- outbound ring occupancy at send time, in 10% steps
+ */
+#define NETVSC_HIST_TX_LAT	12
+#define NETVSC_HIST_POLL	8
+#define NETVSC_HIST_RING	10
+#define NETVSC_HIST_LEN		(NETVSC_HIST_TX_LAT + NETVSC_HIST_POLL + \
+				 NETVSC_HIST_RING)
+
+struct netvsc_queue_hist {
+	u64 tx_lat[NETVSC_HIST_TX_LAT];
+	u64 poll_batch[NETVSC_HIST_POLL];
+	u64 ring_used[NETVSC_HIST_RING];
 };
 
 /* Per channel data */
@@ -781,6 +841,7 @@ struct netvsc_channel {
 	atomic_t queue_sends;
 	struct netvsc_stats tx_stats;
 	struct netvsc_stats rx_stats;
+	struct netvsc_queue_hist hist;
 };
 
 /* Per netvsc device */
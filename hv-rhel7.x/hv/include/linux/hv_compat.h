@@ -652,6 +652,10 @@ again:
 #define U64_MAX                ((u64)~0ULL)
 #endif
 
+#ifndef U32_MAX
+#define U32_MAX                ((u32)~0U)
+#endif
+
 #ifndef for_each_cpu_wrap
 /**
  * for_each_cpu_wrap - iterate over every cpu in a mask, starting at a specified location
@@ -825,6 +825,10 @@ struct vmbus_channel {
 	 */
 	struct kobject			kobj;
 
+	/* Interrupt counts for 2 types of Guest/Host interaction */
+	u64 interrupts;	/* Host to Guest interrupts */
+	u64 sig_events;	/* Guest to Host events */
+
 	/*
 	 * For performance critical channels (storage, networking
 	 * etc,), Hyper-V has a mechanism to enhance the throughput
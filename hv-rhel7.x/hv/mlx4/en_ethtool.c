@@ -99,7 +99,8 @@ mlx4_en_get_drvinfo(struct net_device *dev, struct ethtool_drvinfo *drvinfo)
 
 static const char mlx4_en_priv_flags[][ETH_GSTRING_LEN] = {
 	"blueflame",
-	"phv-bit"
+	"phv-bit",
+	"virt-moder"
 };
 
 static const char main_strings[][ETH_GSTRING_LEN] = {
@@ -116,6 +117,8 @@ static const char main_strings[][ETH_GSTRING_LEN] = {
 	"xmit_more",
 	"queue_stopped", "wake_queue", "tx_timeout", "rx_alloc_failed",
 	"rx_csum_good", "rx_csum_none", "rx_csum_complete", "tx_chksum_offload",
+	"rx_recycle_hit", "rx_recycle_miss",
+	"tx_doorbells",
 
 	/* pf statistics */
 	"pf_rx_packets",
@@ -1796,6 +1799,8 @@ static int mlx4_en_set_priv_flags(struct net_device *dev, u32 flags)
 	bool bf_enabled_old = !!(priv->pflags & MLX4_EN_PRIV_FLAGS_BLUEFLAME);
 	bool phv_enabled_new = !!(flags & MLX4_EN_PRIV_FLAGS_PHV);
 	bool phv_enabled_old = !!(priv->pflags & MLX4_EN_PRIV_FLAGS_PHV);
+	bool vm_enabled_new = !!(flags & MLX4_EN_PRIV_FLAGS_VIRT_MODER);
+	bool vm_enabled_old = !!(priv->pflags & MLX4_EN_PRIV_FLAGS_VIRT_MODER);
 	int i;
 	int ret = 0;
 
@@ -1834,6 +1839,22 @@ static int mlx4_en_set_priv_flags(struct net_device *dev, u32 flags)
 		en_info(priv, "PHV bit %s\n",
 			phv_enabled_new ?  "Enabled" : "Disabled");
 	}
+
+	if (vm_enabled_new != vm_enabled_old) {
+		if (vm_enabled_new)
+			priv->pflags |= MLX4_EN_PRIV_FLAGS_VIRT_MODER;
+		else
+			priv->pflags &= ~MLX4_EN_PRIV_FLAGS_VIRT_MODER;
+		mlx4_en_set_rx_moder_profile(priv);
+
+		/* Start over so the next sample reprograms every ring */
+		for (i = 0; i < priv->rx_ring_num; i++) {
+			priv->last_moder_time[i] = MLX4_EN_AUTO_CONF;
+			priv->virt_moder_rate[i] = 0;
+		}
+		en_info(priv, "Virtualization moderation profile %s\n",
+			vm_enabled_new ?  "Enabled" : "Disabled");
+	}
 	return 0;
 }
 
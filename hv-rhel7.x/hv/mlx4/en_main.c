@@ -75,6 +75,12 @@ MLX4_EN_PARM_INT(pfcrx, 0, "Priority based Flow Control policy on RX[7:0]."
 MLX4_EN_PARM_INT(inline_thold, MAX_INLINE,
 		 "Threshold for using inline data (range: 17-104, default: 104)");
 
+MLX4_EN_PARM_INT(tx_db_batch, MLX4_EN_DEF_TX_DB_BATCH,
+		 "Max descriptors posted per TX doorbell within an xmit_more burst (range: 1-256, default: 32)");
+
+MLX4_EN_PARM_INT(blueflame, 1,
+		 "Use BlueFlame for TX doorbells by default (0 = disabled, default: 1)");
+
 #define MAX_PFC_TX     0xff
 #define MAX_PFC_RX     0xff
 
@@ -173,6 +179,8 @@ static int mlx4_en_get_profile(struct mlx4_en_dev *mdev)
 			MLX4_EN_NUM_UP;
 		params->prof[i].rss_rings = 0;
 		params->prof[i].inline_thold = inline_thold;
+		params->prof[i].tx_db_batch = tx_db_batch;
+		params->prof[i].blueflame = !!blueflame;
 	}
 
 	return 0;
@@ -379,6 +387,13 @@ static void mlx4_en_verify_params(void)
 			inline_thold, MIN_PKT_LEN, MAX_INLINE, MAX_INLINE);
 		inline_thold = MAX_INLINE;
 	}
+
+	if (tx_db_batch < 1 || tx_db_batch > MLX4_EN_MAX_TX_DB_BATCH) {
+		pr_warn("mlx4_en: WARNING: illegal module parameter tx_db_batch %d - should be in range 1-%d, will be changed to default (%d)\n",
+			tx_db_batch, MLX4_EN_MAX_TX_DB_BATCH,
+			MLX4_EN_DEF_TX_DB_BATCH);
+		tx_db_batch = MLX4_EN_DEF_TX_DB_BATCH;
+	}
 }
 
 static int __init mlx4_en_init(void)
@@ -1325,8 +1325,13 @@ static void mlx4_en_set_default_moderation(struct mlx4_en_priv *priv)
 	 */
 	priv->rx_frames = MLX4_EN_RX_COAL_TARGET;
 	priv->rx_usecs = MLX4_EN_RX_COAL_TIME;
-	priv->tx_frames = MLX4_EN_TX_COAL_PKTS;
-	priv->tx_usecs = MLX4_EN_TX_COAL_TIME;
+	if (mlx4_is_slave(priv->mdev->dev)) {
+		priv->tx_frames = MLX4_EN_VF_TX_COAL_PKTS;
+		priv->tx_usecs = MLX4_EN_VF_TX_COAL_TIME;
+	} else {
+		priv->tx_frames = MLX4_EN_TX_COAL_PKTS;
+		priv->tx_usecs = MLX4_EN_TX_COAL_TIME;
+	}
 	en_dbg(INTR, priv, "Default coalesing params for mtu:%d - rx_frames:%d rx_usecs:%d\n",
 	       priv->dev->mtu, priv->rx_frames, priv->rx_usecs);
 
@@ -1338,6 +1343,7 @@ static void mlx4_en_set_default_moderation(struct mlx4_en_priv *priv)
 		priv->last_moder_time[i] = MLX4_EN_AUTO_CONF;
 		priv->last_moder_packets[i] = 0;
 		priv->last_moder_bytes[i] = 0;
+		priv->virt_moder_rate[i] = 0;
 	}
 
 	for (i = 0; i < priv->tx_ring_num; i++) {
@@ -1347,18 +1353,58 @@ static void mlx4_en_set_default_moderation(struct mlx4_en_priv *priv)
 	}
 
 	/* Reset auto-moderation params */
-	priv->pkt_rate_low = MLX4_EN_RX_RATE_LOW;
-	priv->rx_usecs_low = MLX4_EN_RX_COAL_TIME_LOW;
-	priv->pkt_rate_high = MLX4_EN_RX_RATE_HIGH;
-	priv->rx_usecs_high = MLX4_EN_RX_COAL_TIME_HIGH;
+	mlx4_en_set_rx_moder_profile(priv);
 	priv->sample_interval = MLX4_EN_SAMPLE_INTERVAL;
 	priv->adaptive_rx_coal = 1;
 	priv->last_moder_jiffies = 0;
 	priv->last_moder_tx_packets = 0;
 }
 
+/* Load the adaptive RX moderation defaults of the selected profile */
+void mlx4_en_set_rx_moder_profile(struct mlx4_en_priv *priv)
+{
+	priv->rx_usecs_low = MLX4_EN_RX_COAL_TIME_LOW;
+	if (priv->pflags & MLX4_EN_PRIV_FLAGS_VIRT_MODER) {
+		priv->pkt_rate_low = MLX4_EN_VIRT_RATE_LOW;
+		priv->pkt_rate_high = MLX4_EN_VIRT_RATE_HIGH;
+		priv->rx_usecs_high = MLX4_EN_VIRT_COAL_TIME_HIGH;
+	} else {
+		priv->pkt_rate_low = MLX4_EN_RX_RATE_LOW;
+		priv->pkt_rate_high = MLX4_EN_RX_RATE_HIGH;
+		priv->rx_usecs_high = MLX4_EN_RX_COAL_TIME_HIGH;
+	}
+}
+
+/* Pick the RX moderation time for @ring under the virt-moder profile */
+static int mlx4_en_virt_moder_time(struct mlx4_en_priv *priv, int ring,
+				   unsigned long rate)
+{
+	unsigned long avg = priv->virt_moder_rate[ring];
+	int usecs_low = max_t(int, priv->rx_usecs, priv->rx_usecs_low);
+
+	/* Smooth with a 1/4 weight so one bursty sample does not retune */
+	avg = avg - (avg >> 2) + (rate >> 2);
+	priv->virt_moder_rate[ring] = avg;
+
+	/* Small packets are not exempt here: the exit costs the same.
+	 * Once a ring is busy enough to matter it is moderated at least
+	 * rx_usecs, scaling up to rx_usecs_high at pkt_rate_high.
+	 */
+	if (avg < priv->pkt_rate_low / MLX4_EN_VIRT_IDLE_DIV)
+		return priv->rx_usecs_low;
+	if (avg >= priv->pkt_rate_high)
+		return priv->rx_usecs_high;
+	if (avg <= priv->pkt_rate_low || priv->rx_usecs_high <= usecs_low)
+		return usecs_low;
+
+	return (avg - priv->pkt_rate_low) *
+		(priv->rx_usecs_high - usecs_low) /
+		(priv->pkt_rate_high - priv->pkt_rate_low) + usecs_low;
+}
+
 static void mlx4_en_auto_moderation(struct mlx4_en_priv *priv)
 {
+	bool virt = !!(priv->pflags & MLX4_EN_PRIV_FLAGS_VIRT_MODER);
 	unsigned long period = (unsigned long) (jiffies - priv->last_moder_jiffies);
 	struct mlx4_en_cq *cq;
 	unsigned long packets;
@@ -1386,10 +1432,22 @@ static void mlx4_en_auto_moderation(struct mlx4_en_priv *priv)
 		avg_pkt_size = packets ? ((unsigned long) (rx_bytes -
 				priv->last_moder_bytes[ring])) / packets : 0;
 
-		/* Apply auto-moderation only when packet rate
-		 * exceeds a rate that it matters */
-		if (rate > (MLX4_EN_RX_RATE_THRESH / priv->rx_ring_num) &&
-		    avg_pkt_size > MLX4_EN_AVG_PKT_SMALL) {
+		if (virt) {
+			moder_time = mlx4_en_virt_moder_time(priv, ring, rate);
+
+			/* A CQ modify is a round trip to the PF; only
+			 * reprogram on a sizeable change or when going
+			 * back to the low latency setting.
+			 */
+			if (priv->last_moder_time[ring] != MLX4_EN_AUTO_CONF &&
+			    moder_time != priv->rx_usecs_low &&
+			    abs(moder_time - priv->last_moder_time[ring]) <
+			    MLX4_EN_VIRT_MODER_HYST)
+				moder_time = priv->last_moder_time[ring];
+		} else if (rate > (MLX4_EN_RX_RATE_THRESH / priv->rx_ring_num) &&
+			   avg_pkt_size > MLX4_EN_AVG_PKT_SMALL) {
+			/* Apply auto-moderation only when packet rate
+			 * exceeds a rate that it matters */
 			if (rate < priv->pkt_rate_low)
 				moder_time = priv->rx_usecs_low;
 			else if (rate > priv->pkt_rate_high)
@@ -1901,6 +1959,7 @@ static void mlx4_en_clear_stats(struct net_device *dev)
 		priv->tx_ring[i]->wake_queue = 0;
 		priv->tx_ring[i]->tso_packets = 0;
 		priv->tx_ring[i]->xmit_more = 0;
+		priv->tx_ring[i]->doorbells = 0;
 	}
 	for (i = 0; i < priv->rx_ring_num; i++) {
 		priv->rx_ring[i]->bytes = 0;
@@ -1908,6 +1967,8 @@ static void mlx4_en_clear_stats(struct net_device *dev)
 		priv->rx_ring[i]->csum_ok = 0;
 		priv->rx_ring[i]->csum_none = 0;
 		priv->rx_ring[i]->csum_complete = 0;
+		priv->rx_ring[i]->recycle_hit = 0;
+		priv->rx_ring[i]->recycle_miss = 0;
 	}
 }
 
@@ -2932,7 +2993,9 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 	priv->port = port;
 	priv->port_up = false;
 	priv->flags = prof->flags;
-	priv->pflags = MLX4_EN_PRIV_FLAGS_BLUEFLAME;
+	priv->pflags = prof->blueflame ? MLX4_EN_PRIV_FLAGS_BLUEFLAME : 0;
+	if (mlx4_is_slave(mdev->dev))
+		priv->pflags |= MLX4_EN_PRIV_FLAGS_VIRT_MODER;
 	priv->ctrl_flags = cpu_to_be32(MLX4_WQE_CTRL_CQ_UPDATE |
 			MLX4_WQE_CTRL_SOLICITED);
 	priv->num_tx_rings_p_up = mdev->profile.num_tx_rings_p_up;
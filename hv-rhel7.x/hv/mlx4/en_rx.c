@@ -48,7 +48,68 @@
 
 #include "mlx4_en.h"
 
+/* Park a page the allocator is done with, handing over its reference */
+static void mlx4_en_recycle_put(struct mlx4_en_rx_ring *ring,
+				struct page *page, u32 page_size)
+{
+	struct mlx4_en_page_recycle *recycle = &ring->recycle;
+	u32 slot;
+
+	/* Only keep pages that are local to the ring */
+	if (ring->node != NUMA_NO_NODE && page_to_nid(page) != ring->node) {
+		put_page(page);
+		return;
+	}
+
+	/* Full: the oldest page is still busy, let it go */
+	if (recycle->tail - recycle->head == MLX4_EN_RECYCLE_RING_SIZE) {
+		slot = recycle->head++ & (MLX4_EN_RECYCLE_RING_SIZE - 1);
+		put_page(recycle->buf[slot].page);
+	}
+
+	slot = recycle->tail++ & (MLX4_EN_RECYCLE_RING_SIZE - 1);
+	recycle->buf[slot].page = page;
+	recycle->buf[slot].page_size = page_size;
+}
+
+/* Return the oldest parked page if all of its frags have been released */
+static struct page *mlx4_en_recycle_get(struct mlx4_en_rx_ring *ring,
+					const struct mlx4_en_frag_info *frag_info,
+					u32 *page_size)
+{
+	struct mlx4_en_page_recycle *recycle = &ring->recycle;
+	struct page *page;
+	u32 slot;
+
+	if (recycle->head == recycle->tail)
+		return NULL;
+
+	slot = recycle->head & (MLX4_EN_RECYCLE_RING_SIZE - 1);
+	page = recycle->buf[slot].page;
+	if (page_ref_count(page) != 1 ||
+	    recycle->buf[slot].page_size < frag_info->frag_size)
+		return NULL;
+
+	recycle->head++;
+	*page_size = recycle->buf[slot].page_size;
+	return page;
+}
+
+static void mlx4_en_recycle_drain(struct mlx4_en_rx_ring *ring)
+{
+	struct mlx4_en_page_recycle *recycle = &ring->recycle;
+	u32 slot;
+
+	while (recycle->head != recycle->tail) {
+		slot = recycle->head++ & (MLX4_EN_RECYCLE_RING_SIZE - 1);
+		put_page(recycle->buf[slot].page);
+	}
+	recycle->head = 0;
+	recycle->tail = 0;
+}
+
 static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
+			    struct mlx4_en_rx_ring *ring,
 			    struct mlx4_en_rx_alloc *page_alloc,
 			    const struct mlx4_en_frag_info *frag_info,
 			    gfp_t _gfp)
@@ -56,42 +117,55 @@ static int mlx4_alloc_pages(struct mlx4_en_priv *priv,
 	int order;
 	struct page *page;
 	dma_addr_t dma;
+	u32 page_size;
+
+	page = mlx4_en_recycle_get(ring, frag_info, &page_size);
+	if (page) {
+		ring->recycle_hit++;
+		goto map;
+	}
+	ring->recycle_miss++;
 
 	for (order = MLX4_EN_ALLOC_PREFER_ORDER; ;) {
 		gfp_t gfp = _gfp;
 
 		if (order)
 			gfp |= __GFP_COMP | __GFP_NOWARN | __GFP_NOMEMALLOC;
-		page = alloc_pages(gfp, order);
+		page = alloc_pages_node(ring->node, gfp, order);
 		if (likely(page))
 			break;
 		if (--order < 0 ||
 		    ((PAGE_SIZE << order) < frag_info->frag_size))
 			return -ENOMEM;
 	}
-	dma = dma_map_page(priv->ddev, page, 0, PAGE_SIZE << order,
+	page_size = PAGE_SIZE << order;
+map:
+	dma = dma_map_page(priv->ddev, page, 0, page_size,
 			   PCI_DMA_FROMDEVICE);
 	if (dma_mapping_error(priv->ddev, dma)) {
 		put_page(page);
 		return -ENOMEM;
 	}
-	page_alloc->page_size = PAGE_SIZE << order;
+	page_alloc->page_size = page_size;
 	page_alloc->page = page;
 	page_alloc->dma = dma;
 	page_alloc->page_offset = 0;
 	/* Not doing get_page() for each frag is a big win
 	 * on asymetric workloads. Note we can not use atomic_set().
+	 * The page keeps one extra reference owned by the allocator,
+	 * which is handed to the recycle ring once all frags are carved.
 	 */
-	page_ref_add(page, page_alloc->page_size / frag_info->frag_stride - 1);
+	page_ref_add(page, page_alloc->page_size / frag_info->frag_stride);
 	return 0;
 }
 
 static int mlx4_en_alloc_frags(struct mlx4_en_priv *priv,
+			       struct mlx4_en_rx_ring *ring,
 			       struct mlx4_en_rx_desc *rx_desc,
 			       struct mlx4_en_rx_alloc *frags,
-			       struct mlx4_en_rx_alloc *ring_alloc,
 			       gfp_t gfp)
 {
+	struct mlx4_en_rx_alloc *ring_alloc = ring->page_alloc;
 	struct mlx4_en_rx_alloc page_alloc[MLX4_EN_MAX_RX_FRAGS];
 	const struct mlx4_en_frag_info *frag_info;
 	struct page *page;
@@ -107,13 +181,17 @@ static int mlx4_en_alloc_frags(struct mlx4_en_priv *priv,
 		    ring_alloc[i].page_size)
 			continue;
 
-		if (mlx4_alloc_pages(priv, &page_alloc[i], frag_info, gfp))
+		if (mlx4_alloc_pages(priv, ring, &page_alloc[i], frag_info,
+				     gfp))
 			goto out;
 	}
 
 	for (i = 0; i < priv->num_frags; i++) {
 		frags[i] = ring_alloc[i];
 		dma = ring_alloc[i].dma + ring_alloc[i].page_offset;
+		if (page_alloc[i].page != ring_alloc[i].page)
+			mlx4_en_recycle_put(ring, ring_alloc[i].page,
+					    ring_alloc[i].page_size);
 		ring_alloc[i] = page_alloc[i];
 		rx_desc->data[i].addr = cpu_to_be64(dma);
 	}
@@ -128,7 +206,7 @@ out:
 			page = page_alloc[i].page;
 			/* Revert changes done by mlx4_alloc_pages */
 			page_ref_sub(page, page_alloc[i].page_size /
-					   priv->frag_info[i].frag_stride - 1);
+					   priv->frag_info[i].frag_stride);
 			put_page(page);
 		}
 	}
@@ -159,7 +237,7 @@ static int mlx4_en_init_allocator(struct mlx4_en_priv *priv,
 	for (i = 0; i < priv->num_frags; i++) {
 		const struct mlx4_en_frag_info *frag_info = &priv->frag_info[i];
 
-		if (mlx4_alloc_pages(priv, &ring->page_alloc[i],
+		if (mlx4_alloc_pages(priv, ring, &ring->page_alloc[i],
 				     frag_info, GFP_KERNEL | __GFP_COLD))
 			goto out;
 
@@ -179,7 +257,7 @@ out:
 		page = page_alloc->page;
 		/* Revert changes done by mlx4_alloc_pages */
 		page_ref_sub(page, page_alloc->page_size /
-				   priv->frag_info[i].frag_stride - 1);
+				   priv->frag_info[i].frag_stride);
 		put_page(page);
 		page_alloc->page = NULL;
 	}
@@ -206,8 +284,12 @@ static void mlx4_en_destroy_allocator(struct mlx4_en_priv *priv,
 			put_page(page_alloc->page);
 			page_alloc->page_offset += frag_info->frag_stride;
 		}
+		/* Drop the allocator's own reference */
+		put_page(page_alloc->page);
 		page_alloc->page = NULL;
 	}
+
+	mlx4_en_recycle_drain(ring);
 }
 
 static void mlx4_en_init_rx_desc(struct mlx4_en_priv *priv,
@@ -243,7 +325,7 @@ static int mlx4_en_prepare_rx_desc(struct mlx4_en_priv *priv,
 	struct mlx4_en_rx_alloc *frags = ring->rx_info +
 					(index << priv->log_rx_info);
 
-	return mlx4_en_alloc_frags(priv, rx_desc, frags, ring->page_alloc, gfp);
+	return mlx4_en_alloc_frags(priv, ring, rx_desc, frags, gfp);
 }
 
 static inline bool mlx4_en_is_ring_empty(struct mlx4_en_rx_ring *ring)
@@ -371,6 +453,7 @@ int mlx4_en_create_rx_ring(struct mlx4_en_priv *priv,
 
 	ring->prod = 0;
 	ring->cons = 0;
+	ring->node = node;
 	ring->size = size;
 	ring->size_mask = size - 1;
 	ring->stride = stride;
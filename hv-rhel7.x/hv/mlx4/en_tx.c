@@ -192,6 +192,7 @@ int mlx4_en_activate_tx_ring(struct mlx4_en_priv *priv,
 
 	ring->cqn = cq;
 	ring->prod = 0;
+	ring->db_pending = 0;
 	ring->cons = 0xffffffff;
 	ring->last_nr_txbb = 1;
 	memset(ring->tx_info, 0, ring->size * sizeof(struct mlx4_en_tx_info));
@@ -942,7 +943,13 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		netif_tx_stop_queue(ring->tx_queue);
 		ring->queue_stopped++;
 	}
-	send_doorbell = !skb->xmit_more || netif_xmit_stopped(ring->tx_queue);
+
+	/* Defer the doorbell to the end of an xmit_more burst, but never
+	 * leave more than tx_db_batch descriptors unannounced to the HW.
+	 */
+	ring->db_pending++;
+	send_doorbell = !skb->xmit_more || netif_xmit_stopped(ring->tx_queue) ||
+			ring->db_pending >= priv->prof->tx_db_batch;
 
 	real_size = (real_size / 16) & 0x3f;
 
@@ -966,6 +973,8 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 		wmb();
 
 		ring->bf.offset ^= ring->bf.buf_size;
+		ring->doorbells++;
+		ring->db_pending = 0;
 	} else {
 		tx_desc->ctrl.vlan_tag = cpu_to_be16(vlan_tag);
 		if (vlan_proto == ETH_P_8021AD)
@@ -996,6 +1005,8 @@ netdev_tx_t mlx4_en_xmit(struct sk_buff *skb, struct net_device *dev)
 #endif
 				  ring->doorbell_qpn,
 				  ring->bf.uar->map + MLX4_SEND_DOORBELL);
+			ring->doorbells++;
+			ring->db_pending = 0;
 		} else {
 			ring->xmit_more++;
 		}
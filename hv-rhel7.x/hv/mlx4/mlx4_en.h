@@ -96,6 +96,7 @@
 
 #define MLX4_EN_PRIV_FLAGS_BLUEFLAME 1
 #define MLX4_EN_PRIV_FLAGS_PHV	     2
+#define MLX4_EN_PRIV_FLAGS_VIRT_MODER 4
 
 #define MLX4_EN_WATCHDOG_TIMEOUT	(15 * HZ)
 
@@ -114,6 +115,9 @@ enum {
 };
 #define MLX4_EN_MAX_RX_FRAGS	4
 
+/* Number of pages parked per RX ring waiting to be recycled */
+#define MLX4_EN_RECYCLE_RING_SIZE	128
+
 #ifndef CONFIG_GENERIC_HARDIRQS
 /* Minimum packet number till arming the CQ */
 #define MLX4_EN_MIN_RX_ARM	2097152
@@ -145,6 +149,14 @@ enum {
 #define MLX4_EN_TX_COAL_PKTS	16
 #define MLX4_EN_TX_COAL_TIME	0x10
 
+/* Interrupts are costlier for a VF behind a hypervisor; coalesce more */
+#define MLX4_EN_VF_TX_COAL_PKTS	64
+#define MLX4_EN_VF_TX_COAL_TIME	0x40
+
+/* Descriptors that may be posted within an xmit_more burst per doorbell */
+#define MLX4_EN_DEF_TX_DB_BATCH	32
+#define MLX4_EN_MAX_TX_DB_BATCH	256
+
 #define MLX4_EN_RX_RATE_LOW		400000
 #define MLX4_EN_RX_COAL_TIME_LOW	0
 #define MLX4_EN_RX_RATE_HIGH		450000
@@ -154,6 +166,20 @@ enum {
 #define MLX4_EN_SAMPLE_INTERVAL		0
 #define MLX4_EN_AVG_PKT_SMALL		256
 
+/* "virt-moder" adaptive RX moderation profile, used by default on VFs.
+ * Every interrupt is a VM exit and every CQ modify is a command to the
+ * PF, so moderation starts at lower rates, goes deeper, and only moves
+ * when the smoothed per-ring rate changes the target noticeably.
+ * These are the pkt_rate_low/high and rx_usecs_high defaults loaded
+ * when the profile is selected; ethtool -C overrides them as usual.
+ */
+#define MLX4_EN_VIRT_RATE_LOW		20000
+#define MLX4_EN_VIRT_RATE_HIGH		200000
+#define MLX4_EN_VIRT_COAL_TIME_HIGH	256
+/* Below pkt_rate_low / MLX4_EN_VIRT_IDLE_DIV a ring counts as idle */
+#define MLX4_EN_VIRT_IDLE_DIV		10
+#define MLX4_EN_VIRT_MODER_HYST		16
+
 #define MLX4_EN_AUTO_CONF	0xffff
 
 #define MLX4_EN_DEF_RX_PAUSE	1
@@ -260,6 +286,19 @@ struct mlx4_en_rx_alloc {
 	u32		page_size;
 };
 
+/* Pages the RX allocator has finished carving frags from. Each one still
+ * carries the allocator's own reference and is reused once every frag
+ * has been released, i.e. when that reference is the only one left.
+ */
+struct mlx4_en_page_recycle {
+	u32 head;	/* oldest parked page */
+	u32 tail;	/* next free slot */
+	struct {
+		struct page	*page;
+		u32		page_size;
+	} buf[MLX4_EN_RECYCLE_RING_SIZE];
+};
+
 struct mlx4_en_tx_ring {
 	/* cache line used and dirtied in tx completion
 	 * (mlx4_en_free_tx_buf())
@@ -275,6 +314,8 @@ struct mlx4_en_tx_ring {
 	unsigned long		tx_csum;
 	unsigned long		tso_packets;
 	unsigned long		xmit_more;
+	unsigned long		doorbells;
+	u32			db_pending; /* descriptors posted since last doorbell */
 	unsigned int		tx_dropped;
 	struct mlx4_bf		bf;
 	unsigned long		queue_stopped;
@@ -330,8 +371,12 @@ struct mlx4_en_rx_ring {
 	unsigned long csum_none;
 	unsigned long csum_complete;
 	unsigned long dropped;
+	unsigned long recycle_hit;
+	unsigned long recycle_miss;
 	int hwtstamp_rx_filter;
+	int node;
 	cpumask_var_t affinity_mask;
+	struct mlx4_en_page_recycle recycle;
 };
 
 struct mlx4_en_cq {
@@ -368,6 +413,8 @@ struct mlx4_en_port_profile {
 	u8 tx_ppp;
 	int rss_rings;
 	int inline_thold;
+	u32 tx_db_batch;
+	u8 blueflame;
 	struct hwtstamp_config hwtstamp_config;
 };
 
@@ -504,6 +551,7 @@ struct mlx4_en_priv {
 	unsigned long last_moder_bytes[MAX_RX_RINGS];
 	unsigned long last_moder_jiffies;
 	int last_moder_time[MAX_RX_RINGS];
+	unsigned long virt_moder_rate[MAX_RX_RINGS]; /* smoothed pkts/sec */
 	u16 rx_usecs;
 	u16 rx_frames;
 	u16 tx_usecs;
@@ -627,6 +675,8 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 int mlx4_en_start_port(struct net_device *dev);
 void mlx4_en_stop_port(struct net_device *dev, int detach);
 
+void mlx4_en_set_rx_moder_profile(struct mlx4_en_priv *priv);
+
 void mlx4_en_set_stats_bitmap(struct mlx4_dev *dev,
 			      struct mlx4_en_stats_bitmap *stats_bitmap,
 			      u8 rx_ppp, u8 rx_pause,
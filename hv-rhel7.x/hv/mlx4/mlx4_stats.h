@@ -42,7 +42,10 @@ struct mlx4_en_port_stats {
 	unsigned long rx_chksum_none;
 	unsigned long rx_chksum_complete;
 	unsigned long tx_chksum_offload;
-#define NUM_PORT_STATS		10
+	unsigned long rx_recycle_hit;
+	unsigned long rx_recycle_miss;
+	unsigned long tx_doorbells;
+#define NUM_PORT_STATS		13
 };
 
 struct mlx4_en_perf_stats {
@@ -34,6 +34,7 @@
 #include <linux/reciprocal_div.h>
 
 #include "hyperv_net.h"
+#include "netvsc_trace.h"
 
 /*
  * Switch the data path from the synthetic interface to the VF
@@ -606,57 +607,138 @@ static inline void netvsc_free_send_slot(struct netvsc_device *net_device,
 	sync_change_bit(index, net_device->send_section_map);
 }
 
+static inline void netvsc_hist_add(u64 *hist, unsigned int len, u64 val)
+{
+	hist[min_t(unsigned int, fls64(val), len - 1)]++;
+}
+
+/*
+ * TX completions gathered during one netvsc_poll() pass. They are
+ * applied to their queue in one go: one stats update, one queue_sends
+ * update and one wake check instead of one of each per packet. Freed
+ * send sections are cleared a bitmap word at a time.
+ */
+struct netvsc_tx_batch {
+	struct vmbus_channel *channel;
+	u16 q_idx;
+	u32 sends;
+	u32 packets;
+	u64 bytes;
+	unsigned int sect_word;
+	unsigned long sect_mask;
+};
+
+static void netvsc_free_send_slots(struct netvsc_device *net_device,
+				   struct netvsc_tx_batch *batch)
+{
+	unsigned long *map = net_device->send_section_map + batch->sect_word;
+	unsigned long old;
+
+	if (!batch->sect_mask)
+		return;
+
+	/* Senders may be claiming other bits of the same word */
+	do {
+		old = READ_ONCE(*map);
+	} while (cmpxchg(map, old, old & ~batch->sect_mask) != old);
+
+	batch->sect_mask = 0;
+}
+
+static void netvsc_tx_batch_flush(struct netvsc_device *net_device,
+				  struct net_device *ndev,
+				  struct netvsc_tx_batch *batch)
+{
+	struct net_device_context *ndev_ctx = netdev_priv(ndev);
+	struct netvsc_channel *nvchan;
+	struct netdev_queue *txq;
+	int queue_sends;
+
+	netvsc_free_send_slots(net_device, batch);
+
+	if (!batch->sends)
+		return;
+
+	nvchan = &net_device->chan_table[batch->q_idx];
+
+#if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(7,0))
+	u64_stats_update_begin(&nvchan->tx_stats.syncp);
+	nvchan->tx_stats.packets += batch->packets;
+	nvchan->tx_stats.bytes += batch->bytes;
+	u64_stats_update_end(&nvchan->tx_stats.syncp);
+#else
+	ndev->stats.tx_bytes += batch->bytes;
+	ndev->stats.tx_packets += batch->packets;
+#endif
+
+	queue_sends = atomic_sub_return(batch->sends, &nvchan->queue_sends);
+
+	batch->sends = 0;
+	batch->packets = 0;
+	batch->bytes = 0;
+
+	if (net_device->destroy && queue_sends == 0)
+		wake_up(&net_device->wait_drain);
+
+	txq = netdev_get_tx_queue(ndev, batch->q_idx);
+	if (netif_tx_queue_stopped(txq) &&
+	    (hv_ringbuf_avail_percent(&batch->channel->outbound) > RING_AVAIL_PERCENT_HIWATER ||
+	     queue_sends < 1)) {
+		netif_tx_wake_queue(txq);
+		this_cpu_inc(ndev_ctx->eth_stats->wake_queue);
+	}
+}
+
 static void netvsc_send_tx_complete(struct netvsc_device *net_device,
 				    struct vmbus_channel *incoming_channel,
 				    struct hv_device *device,
 				    const struct vmpacket_descriptor *desc,
-				    int budget)
+				    int budget, struct netvsc_tx_batch *batch)
 {
 	struct sk_buff *skb = (struct sk_buff *)(unsigned long)desc->trans_id;
 	struct net_device *ndev = hv_get_drvdata(device);
-	struct net_device_context *ndev_ctx = netdev_priv(ndev);
 	struct vmbus_channel *channel = device->channel;
+	const struct hv_netvsc_packet *packet = NULL;
 	u16 q_idx = 0;
-	int queue_sends;
 
-	/* Notify the layer above us */
 	if (likely(skb)) {
-		const struct hv_netvsc_packet *packet
-			= (struct hv_netvsc_packet *)skb->cb;
-		u32 send_index = packet->send_buf_index;
-		struct netvsc_stats *tx_stats;
-
-		if (send_index != NETVSC_INVALID_INDEX)
-			netvsc_free_send_slot(net_device, send_index);
+		packet = (struct hv_netvsc_packet *)skb->cb;
 		q_idx = packet->q_idx;
 		channel = incoming_channel;
+	}
 
-#if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(7,0))
-		tx_stats = &net_device->chan_table[q_idx].tx_stats;
+	/* Completions normally all belong to the queue of this channel */
+	if (batch->sends && batch->q_idx != q_idx)
+		netvsc_tx_batch_flush(net_device, ndev, batch);
 
-		u64_stats_update_begin(&tx_stats->syncp);
-		tx_stats->packets += packet->total_packets;
-		tx_stats->bytes += packet->total_bytes;
-		u64_stats_update_end(&tx_stats->syncp);
-#else
-		ndev->stats.tx_bytes += packet->total_bytes;
-		ndev->stats.tx_packets += packet->total_packets;
-#endif 
+	batch->q_idx = q_idx;
+	batch->channel = channel;
+	batch->sends++;
 
-		napi_consume_skb(skb, budget);
-	}
+	/* Notify the layer above us */
+	if (likely(skb)) {
+		u32 send_index = packet->send_buf_index;
 
-	queue_sends =
-		atomic_dec_return(&net_device->chan_table[q_idx].queue_sends);
+		if (send_index != NETVSC_INVALID_INDEX) {
+			if (batch->sect_mask &&
+			    batch->sect_word != BIT_WORD(send_index))
+				netvsc_free_send_slots(net_device, batch);
 
-	if (net_device->destroy && queue_sends == 0)
-		wake_up(&net_device->wait_drain);
+			batch->sect_word = BIT_WORD(send_index);
+			batch->sect_mask |= BIT_MASK(send_index);
+		}
 
-	if (netif_tx_queue_stopped(netdev_get_tx_queue(ndev, q_idx)) &&
-	    (hv_ringbuf_avail_percent(&channel->outbound) > RING_AVAIL_PERCENT_HIWATER ||
-	     queue_sends < 1)) {
-		netif_tx_wake_queue(netdev_get_tx_queue(ndev, q_idx));
-		ndev_ctx->eth_stats.wake_queue++;
+		if (packet->send_time)
+			netvsc_hist_add(net_device->chan_table[q_idx].hist.tx_lat,
+					NETVSC_HIST_TX_LAT,
+					div_u64(ktime_to_ns(ktime_get()) -
+						packet->send_time,
+						NSEC_PER_USEC));
+
+		batch->packets += packet->total_packets;
+		batch->bytes += packet->total_bytes;
+
+		napi_consume_skb(skb, budget);
 	}
 }
 
@@ -664,7 +746,7 @@ static void netvsc_send_completion(struct netvsc_device *net_device,
                                    struct vmbus_channel *incoming_channel,
 				   struct hv_device *device,
 				   const struct vmpacket_descriptor *desc,
-				   int budget)
+				   int budget, struct netvsc_tx_batch *batch)
 {
 	struct nvsp_message *nvsp_packet = hv_pkt_data(desc);
 	struct net_device *ndev = hv_get_drvdata(device);
@@ -682,7 +764,7 @@ static void netvsc_send_completion(struct netvsc_device *net_device,
 
 	case NVSP_MSG1_TYPE_SEND_RNDIS_PKT_COMPLETE:
 		netvsc_send_tx_complete(net_device, incoming_channel,
-					device, desc, budget);
+					device, desc, budget, batch);
 		break;
 
 	default:
@@ -784,6 +866,15 @@ static inline int netvsc_send_pkt(
 	if (out_channel->rescind)
 		return -ENODEV;
 
+	packet->send_time = 0;
+	if (queue_hist && skb) {
+		nvchan->hist.ring_used[min_t(u32, (100 - ring_avail) / 10,
+					     NETVSC_HIST_RING - 1)]++;
+		packet->send_time = ktime_to_ns(ktime_get());
+	}
+
+	trace_rndis_send(ndev, out_channel, packet, &nvmsg);
+
 	if (packet->page_buf_cnt) {
 		if (packet->cp_partial)
 			pb += packet->rmsg_pgcnt;
@@ -804,14 +895,14 @@ static inline int netvsc_send_pkt(
 
 		if (ring_avail < RING_AVAIL_PERCENT_LOWATER) {
 			netif_tx_stop_queue(txq);
-			ndev_ctx->eth_stats.stop_queue++;
+			this_cpu_inc(ndev_ctx->eth_stats->stop_queue);
 		}
 	} else if (ret == -EAGAIN) {
 		netif_tx_stop_queue(txq);
-		ndev_ctx->eth_stats.stop_queue++;
+		this_cpu_inc(ndev_ctx->eth_stats->stop_queue);
 		if (atomic_read(&nvchan->queue_sends) < 1) {
 			netif_tx_wake_queue(txq);
-			ndev_ctx->eth_stats.wake_queue++;
+			this_cpu_inc(ndev_ctx->eth_stats->wake_queue);
 			ret = -ENOSPC;
 		}
 	} else {
@@ -890,7 +981,7 @@ int netvsc_send(struct net_device_context *ndev_ctx,
 		   net_device->send_section_size) {
 		section_index = netvsc_get_next_send_section(net_device);
 		if (unlikely(section_index == NETVSC_INVALID_INDEX)) {
-			++ndev_ctx->eth_stats.tx_send_full;
+			this_cpu_inc(ndev_ctx->eth_stats->tx_send_full);
 		} else {
 			move_pkt_msd(&msd_send, &msd_skb, msdp);
 			msd_len = 0;
@@ -981,7 +1072,7 @@ static int send_recv_completions(struct net_device *ndev,
 		if (unlikely(ret)) {
 			struct net_device_context *ndev_ctx = netdev_priv(ndev);
 
-			++ndev_ctx->eth_stats.rx_comp_busy;
+			this_cpu_inc(ndev_ctx->eth_stats->rx_comp_busy);
 			return ret;
 		}
 
@@ -1082,6 +1173,8 @@ static int netvsc_receive(struct net_device *ndev,
 			+ vmxferpage_packet->ranges[i].byte_offset;
 		u32 buflen = vmxferpage_packet->ranges[i].byte_count;
 
+		trace_rndis_recv(ndev, channel, desc, data);
+
 		/* Pass it to the upper layer */
 		status = rndis_filter_receive(ndev, net_device,
 					      channel, data, buflen);
@@ -1142,7 +1235,7 @@ static int netvsc_process_raw_pkt(struct hv_device *device,
 				  struct netvsc_device *net_device,
 				  struct net_device *ndev,
 				  const struct vmpacket_descriptor *desc,
-				  int budget)
+				  int budget, struct netvsc_tx_batch *batch)
 {
 	struct net_device_context *net_device_ctx = netdev_priv(ndev);
 	struct nvsp_message *nvmsg = hv_pkt_data(desc);
@@ -1150,7 +1243,7 @@ static int netvsc_process_raw_pkt(struct hv_device *device,
 	switch (desc->type) {
 	case VM_PKT_COMP:
 		netvsc_send_completion(net_device, channel, device,
-				       desc, budget);
+				       desc, budget, batch);
 		break;
 
 	case VM_PKT_DATA_USING_XFER_PAGES:
@@ -1190,6 +1283,7 @@ int netvsc_poll(struct napi_struct *napi, int budget)
 	struct vmbus_channel *channel = nvchan->channel;
 	struct hv_device *device = netvsc_channel_to_device(channel);
 	struct net_device *ndev = hv_get_drvdata(device);
+	struct netvsc_tx_batch batch = { .sends = 0, .sect_mask = 0 };
 	int work_done = 0;
 
 	/* If starting a new interval */
@@ -1198,10 +1292,17 @@ int netvsc_poll(struct napi_struct *napi, int budget)
 
 	while (nvchan->desc && work_done < budget) {
 		work_done += netvsc_process_raw_pkt(device, channel, net_device,
-						    ndev, nvchan->desc, budget);
+						    ndev, nvchan->desc, budget,
+						    &batch);
 		nvchan->desc = hv_pkt_iter_next(channel, nvchan->desc);
 	}
 
+	netvsc_tx_batch_flush(net_device, ndev, &batch);
+
+	if (queue_hist)
+		netvsc_hist_add(nvchan->hist.poll_batch, NETVSC_HIST_POLL,
+				work_done);
+
 	/* If send of pending receive completions suceeded
 	 *   and did not exhaust NAPI budget this time
 	 *   and not doing busy poll
@@ -36,6 +36,7 @@
 #include <linux/rtnetlink.h>
 #include <linux/netpoll.h>
 #include <linux/reciprocal_div.h>
+#include <linux/cpu_rmap.h>
 
 #include <net/arp.h>
 #include <net/route.h>
@@ -47,6 +48,9 @@
 
 #include "hyperv_net.h"
 
+#define CREATE_TRACE_POINTS
+#include "netvsc_trace.h"
+
 #define RING_SIZE_MIN		64
 
 #define LINKCHANGE_INT (2 * HZ)
@@ -72,6 +76,10 @@ static int debug = -1;
 module_param(debug, int, S_IRUGO);
 MODULE_PARM_DESC(debug, "Debug level (0=none,...,16=all)");
 
+bool queue_hist;
+module_param(queue_hist, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(queue_hist, "Collect per queue latency and ring histograms for ethtool -S");
+
 static void netvsc_set_multicast_list(struct net_device *net)
 {
 	struct net_device_context *net_device_ctx = netdev_priv(net);
@@ -458,6 +466,75 @@ static int netvsc_get_slots(struct sk_buff *skb)
 	return slots + frag_slots;
 }
 
+/*
+ * Cut the number of page buffers an skb needs by at least @excess by
+ * copying runs of fragments that fit into one page into a new page.
+ * Only the offending fragments are copied, unlike skb_linearize() which
+ * reallocates and copies the whole packet. Returns 0 on success;
+ * otherwise the skb is still valid, possibly partly compacted.
+ */
+static int netvsc_compact_frags(struct sk_buff *skb, int excess)
+{
+	struct skb_shared_info *shinfo;
+	int i, j, k, offset;
+
+	if (skb_has_frag_list(skb) ||
+	    (skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY))
+		return -EINVAL;
+
+	/* The frags are shared with clones, e.g. the TCP retransmit queue */
+	if (skb_unclone(skb, GFP_ATOMIC))
+		return -ENOMEM;
+
+	shinfo = skb_shinfo(skb);
+	offset = skb_headlen(skb);
+
+	for (i = 0; i < shinfo->nr_frags && excess > 0; i++) {
+		unsigned int len = 0;
+		struct page *page;
+		int slots = 0;
+
+		for (j = i; j < shinfo->nr_frags; j++) {
+			const skb_frag_t *frag = &shinfo->frags[j];
+			unsigned int size = skb_frag_size(frag);
+
+			if (len + size > PAGE_SIZE)
+				break;
+
+			len += size;
+			slots += PFN_UP((frag->page_offset & ~PAGE_MASK) + size);
+		}
+
+		/* Nothing to gain, frags i..j-1 already take a single slot */
+		if (slots <= 1) {
+			offset += skb_frag_size(&shinfo->frags[i]);
+			continue;
+		}
+
+		page = alloc_page(GFP_ATOMIC | __GFP_NOWARN);
+		if (!page)
+			return -ENOMEM;
+
+		if (skb_copy_bits(skb, offset, page_address(page), len)) {
+			__free_page(page);
+			return -EFAULT;
+		}
+
+		for (k = i; k < j; k++)
+			__skb_frag_unref(&shinfo->frags[k]);
+
+		__skb_fill_page_desc(skb, i, page, 0, len);
+		memmove(&shinfo->frags[i + 1], &shinfo->frags[j],
+			(shinfo->nr_frags - j) * sizeof(skb_frag_t));
+		shinfo->nr_frags -= j - i - 1;
+
+		offset += len;
+		excess -= slots - 1;
+	}
+
+	return excess > 0 ? -E2BIG : 0;
+}
+
 static u32 net_checksum_info(struct sk_buff *skb)
 {
 	if (skb->protocol == htons(ETH_P_IP)) {
@@ -529,19 +606,23 @@ static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
 
 	/* We can only transmit MAX_PAGE_BUFFER_COUNT number
 	 * of pages in a single packet. If skb is scattered around
-	 * more pages we try linearizing it.
+	 * more pages we first try copying its small fragments
+	 * together, and only then linearizing it.
 	 */
 	num_data_pgs = netvsc_get_slots(skb) + 2;
 
 	if (unlikely(num_data_pgs > MAX_PAGE_BUFFER_COUNT)) {
-		++net_device_ctx->eth_stats.tx_scattered;
+		this_cpu_inc(net_device_ctx->eth_stats->tx_scattered);
 
-		if (skb_linearize(skb))
+		if (!netvsc_compact_frags(skb,
+				num_data_pgs - MAX_PAGE_BUFFER_COUNT))
+			this_cpu_inc(net_device_ctx->eth_stats->tx_compacted);
+		else if (skb_linearize(skb))
 			goto no_memory;
 
 		num_data_pgs = netvsc_get_slots(skb) + 2;
 		if (num_data_pgs > MAX_PAGE_BUFFER_COUNT) {
-			++net_device_ctx->eth_stats.tx_too_big;
+			this_cpu_inc(net_device_ctx->eth_stats->tx_too_big);
 			goto drop;
 		}
 	}
@@ -689,12 +770,12 @@ static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
 		return NETDEV_TX_OK;
 
 	if (ret == -EAGAIN) {
-		++net_device_ctx->eth_stats.tx_busy;
+		this_cpu_inc(net_device_ctx->eth_stats->tx_busy);
 		return NETDEV_TX_BUSY;
 	}
 
 	if (ret == -ENOSPC)
-		++net_device_ctx->eth_stats.tx_no_space;
+		this_cpu_inc(net_device_ctx->eth_stats->tx_no_space);
 
 drop:
 	dev_kfree_skb_any(skb);
@@ -703,7 +784,7 @@ drop:
 	return NETDEV_TX_OK;
 
 no_memory:
-	++net_device_ctx->eth_stats.tx_no_memory;
+	this_cpu_inc(net_device_ctx->eth_stats->tx_no_memory);
 	goto drop;
 }
 
@@ -800,6 +881,44 @@ static struct sk_buff *netvsc_alloc_recv_skb(struct net_device *net,
  * netvsc_recf_callback - Callback when we receive a packet from the
  * "wire" on the specified device.
  */
+/* First rule matching an IPv4 TCP/UDP packet, or NULL */
+static const struct netvsc_ntuple_rule *
+netvsc_ntuple_match(const struct netvsc_ntuple_table *tbl,
+		    const struct sk_buff *skb)
+{
+	const struct iphdr *iph;
+	const __be16 *ports;
+	u32 i;
+
+	if (skb->protocol != htons(ETH_P_IP) ||
+	    skb_headlen(skb) < sizeof(struct iphdr))
+		return NULL;
+
+	iph = (const struct iphdr *)skb->data;
+	if (iph->ihl < 5 || ip_is_fragment(iph) ||
+	    skb_headlen(skb) < iph->ihl * 4 + 2 * sizeof(__be16))
+		return NULL;
+
+	ports = (const __be16 *)(skb->data + iph->ihl * 4);
+
+	for (i = 0; i < tbl->cnt; i++) {
+		const struct netvsc_ntuple_rule *rule = &tbl->rules[i];
+		const struct ethtool_tcpip4_spec *v = &rule->fs.h_u.tcp_ip4_spec;
+		const struct ethtool_tcpip4_spec *m = &rule->fs.m_u.tcp_ip4_spec;
+
+		if (iph->protocol != rule->proto ||
+		    ((iph->saddr ^ v->ip4src) & m->ip4src) ||
+		    ((iph->daddr ^ v->ip4dst) & m->ip4dst) ||
+		    ((ports[0] ^ v->psrc) & m->psrc) ||
+		    ((ports[1] ^ v->pdst) & m->pdst))
+			continue;
+
+		return rule;
+	}
+
+	return NULL;
+}
+
 int netvsc_recv_callback(struct net_device *net,
 			 struct netvsc_device *net_device,
 			 struct vmbus_channel *channel,
@@ -810,6 +929,7 @@ int netvsc_recv_callback(struct net_device *net,
 	struct net_device_context *net_device_ctx = netdev_priv(net);
 	u16 q_idx = channel->offermsg.offer.sub_channel_index;
 	struct netvsc_channel *nvchan = &net_device->chan_table[q_idx];
+	const struct netvsc_ntuple_table *ntuple;
 	struct sk_buff *skb;
 	struct netvsc_stats *rx_stats;
 
@@ -820,7 +940,7 @@ int netvsc_recv_callback(struct net_device *net,
 	skb = netvsc_alloc_recv_skb(net, &nvchan->napi,
 				    csum_info, vlan, data, len);
 	if (unlikely(!skb)) {
-		++net_device_ctx->eth_stats.rx_no_memory;
+		this_cpu_inc(net_device_ctx->eth_stats->rx_no_memory);
 		rcu_read_unlock();
 		return NVSP_STAT_FAIL;
 	}
@@ -843,6 +963,29 @@ int netvsc_recv_callback(struct net_device *net,
 		++rx_stats->multicast;
 	u64_stats_update_end(&rx_stats->syncp);
 
+	/*
+	 * Steered flows are relabeled with the rule's queue, so RPS hands
+	 * them to the CPUs in that queue's rps_cpus.
+	 */
+	ntuple = rcu_dereference_bh(net_device_ctx->ntuple);
+	if (unlikely(ntuple)) {
+		const struct netvsc_ntuple_rule *rule
+			= netvsc_ntuple_match(ntuple, skb);
+
+		if (rule && rule->queue == NETVSC_NTUPLE_DROP) {
+			this_cpu_inc(
+				net_device_ctx->eth_stats->rx_ntuple_dropped);
+			kfree_skb(skb);
+			return 0;
+		}
+
+		if (rule && rule->queue < net_device->num_chn) {
+			skb_record_rx_queue(skb, rule->queue);
+			this_cpu_inc(
+				net_device_ctx->eth_stats->rx_ntuple_steered);
+		}
+	}
+
 	napi_gro_receive(&nvchan->napi, skb);
 	return 0;
 }
@@ -921,6 +1064,8 @@ static int netvsc_set_channels(struct net_device *net,
 	if (was_opened)
 		rndis_filter_open(nvdev);
 
+	netvsc_arfs_setup(net, nvdev);
+
 	/* We may have missed link change notifications */
 	net_device_ctx->last_reconfig = 0;
 	schedule_delayed_work(&net_device_ctx->dwork, 0);
@@ -1173,6 +1318,7 @@ static const struct {
 	u16 offset;
 } netvsc_stats[] = {
 	{ "tx_scattered", offsetof(struct netvsc_ethtool_stats, tx_scattered) },
+	{ "tx_compacted", offsetof(struct netvsc_ethtool_stats, tx_compacted) },
 	{ "tx_no_memory", offsetof(struct netvsc_ethtool_stats, tx_no_memory) },
 	{ "tx_no_space",  offsetof(struct netvsc_ethtool_stats, tx_no_space) },
 	{ "tx_too_big",	  offsetof(struct netvsc_ethtool_stats, tx_too_big) },
@@ -1182,6 +1328,12 @@ static const struct {
 	{ "rx_no_memory", offsetof(struct netvsc_ethtool_stats, rx_no_memory) },
 	{ "stop_queue",   offsetof(struct netvsc_ethtool_stats, stop_queue) },
 	{ "wake_queue",   offsetof(struct netvsc_ethtool_stats, wake_queue) },
+	{ "rx_ntuple_steered",
+	  offsetof(struct netvsc_ethtool_stats, rx_ntuple_steered) },
+	{ "rx_ntuple_dropped",
+	  offsetof(struct netvsc_ethtool_stats, rx_ntuple_dropped) },
+	{ "rx_arfs_updates",
+	  offsetof(struct netvsc_ethtool_stats, rx_arfs_updates) },
 }, vf_stats[] = {
 	{ "vf_rx_packets", offsetof(struct netvsc_vf_pcpu_stats, rx_packets) },
 	{ "vf_rx_bytes",   offsetof(struct netvsc_vf_pcpu_stats, rx_bytes) },
@@ -1193,8 +1345,14 @@ static const struct {
 #define NETVSC_GLOBAL_STATS_LEN	ARRAY_SIZE(netvsc_stats)
 #define NETVSC_VF_STATS_LEN	ARRAY_SIZE(vf_stats)
 
-/* 4 statistics per queue (rx/tx packets/bytes) */
-#define NETVSC_QUEUE_STATS_LEN(dev) ((dev)->num_chn * 4)
+/* 4 statistics per queue (rx/tx packets/bytes) plus the histograms */
+#define NETVSC_QUEUE_STATS_LEN(dev) ((dev)->num_chn * (4 + NETVSC_HIST_LEN))
+
+/* Lower bound of a log2 histogram bucket */
+static inline u32 netvsc_hist_bound(int bucket)
+{
+	return bucket ? 1U << (bucket - 1) : 0;
+}
 
 static int netvsc_get_sset_count(struct net_device *dev, int string_set)
 {
@@ -1219,18 +1377,25 @@ static void netvsc_get_ethtool_stats(struct net_device *dev,
 {
 	struct net_device_context *ndc = netdev_priv(dev);
 	struct netvsc_device *nvdev = rtnl_dereference(ndc->nvdev);
-	const void *nds = &ndc->eth_stats;
 	const struct netvsc_stats *qstats;
+	const struct netvsc_queue_hist *hist;
 	struct netvsc_vf_pcpu_stats sum;
 	unsigned int start;
 	u64 packets, bytes;
-	int i, j;
+	int i, j, k, cpu;
 
 	if (!nvdev)
 		return;
 
-	for (i = 0; i < NETVSC_GLOBAL_STATS_LEN; i++)
-		data[i] = *(unsigned long *)(nds + netvsc_stats[i].offset);
+	for (i = 0; i < NETVSC_GLOBAL_STATS_LEN; i++) {
+		data[i] = 0;
+		for_each_possible_cpu(cpu) {
+			const void *nds = per_cpu_ptr(ndc->eth_stats, cpu);
+
+			data[i] += *(unsigned long *)(nds +
+						      netvsc_stats[i].offset);
+		}
+	}
 
 	netvsc_get_vf_stats(dev, &sum);
 	for (j = 0; j < NETVSC_VF_STATS_LEN; j++)
@@ -1255,6 +1420,14 @@ static void netvsc_get_ethtool_stats(struct net_device *dev,
 		} while (u64_stats_fetch_retry_irq(&qstats->syncp, start));
 		data[i++] = packets;
 		data[i++] = bytes;
+
+		hist = &nvdev->chan_table[j].hist;
+		for (k = 0; k < NETVSC_HIST_TX_LAT; k++)
+			data[i++] = hist->tx_lat[k];
+		for (k = 0; k < NETVSC_HIST_POLL; k++)
+			data[i++] = hist->poll_batch[k];
+		for (k = 0; k < NETVSC_HIST_RING; k++)
+			data[i++] = hist->ring_used[k];
 	}
 }
 
@@ -1263,7 +1436,7 @@ static void netvsc_get_strings(struct net_device *dev, u32 stringset, u8 *data)
 	struct net_device_context *ndc = netdev_priv(dev);
 	struct netvsc_device *nvdev = rtnl_dereference(ndc->nvdev);
 	u8 *p = data;
-	int i;
+	int i, k;
 
 	if (!nvdev)
 		return;
@@ -1289,6 +1462,22 @@ static void netvsc_get_strings(struct net_device *dev, u32 stringset, u8 *data)
 			p += ETH_GSTRING_LEN;
 			sprintf(p, "rx_queue_%u_bytes", i);
 			p += ETH_GSTRING_LEN;
+
+			for (k = 0; k < NETVSC_HIST_TX_LAT; k++) {
+				sprintf(p, "tx_queue_%u_lat_us_ge_%u", i,
+					netvsc_hist_bound(k));
+				p += ETH_GSTRING_LEN;
+			}
+			for (k = 0; k < NETVSC_HIST_POLL; k++) {
+				sprintf(p, "rx_queue_%u_poll_batch_ge_%u", i,
+					netvsc_hist_bound(k));
+				p += ETH_GSTRING_LEN;
+			}
+			for (k = 0; k < NETVSC_HIST_RING; k++) {
+				sprintf(p, "tx_queue_%u_ring_used_ge_%u", i,
+					k * 10);
+				p += ETH_GSTRING_LEN;
+			}
 		}
 
 		break;
@@ -1318,6 +1507,39 @@ netvsc_get_rss_hash_opts(struct ethtool_rxnfc *info)
 	return 0;
 }
 
+static int netvsc_get_ntuple(const struct netvsc_ntuple_table *tbl,
+			     struct ethtool_rxnfc *info, u32 *rules)
+{
+	u32 i, cnt = tbl ? tbl->cnt : 0;
+
+	info->data = NETVSC_NTUPLE_MAX;
+
+	switch (info->cmd) {
+	case ETHTOOL_GRXCLSRLCNT:
+		info->rule_cnt = cnt;
+		return 0;
+
+	case ETHTOOL_GRXCLSRULE:
+		for (i = 0; i < cnt; i++) {
+			if (tbl->rules[i].fs.location == info->fs.location) {
+				info->fs = tbl->rules[i].fs;
+				return 0;
+			}
+		}
+		return -ENOENT;
+
+	case ETHTOOL_GRXCLSRLALL:
+		if (cnt > info->rule_cnt)
+			return -EMSGSIZE;
+		for (i = 0; i < cnt; i++)
+			rules[i] = tbl->rules[i].fs.location;
+		info->rule_cnt = cnt;
+		return 0;
+	}
+
+	return -EOPNOTSUPP;
+}
+
 static int
 netvsc_get_rxnfc(struct net_device *dev, struct ethtool_rxnfc *info,
 		 u32 *rules)
@@ -1335,10 +1557,301 @@ netvsc_get_rxnfc(struct net_device *dev, struct ethtool_rxnfc *info,
 
 	case ETHTOOL_GRXFH:
 		return netvsc_get_rss_hash_opts(info);
+
+	case ETHTOOL_GRXCLSRLCNT:
+	case ETHTOOL_GRXCLSRULE:
+	case ETHTOOL_GRXCLSRLALL:
+		return netvsc_get_ntuple(rtnl_dereference(ndc->ntuple),
+					 info, rules);
 	}
 	return -EOPNOTSUPP;
 }
 
+/*
+ * Insert (new_rule != NULL) or delete the rule at @loc by publishing a new
+ * copy of the rule table.
+ */
+static int netvsc_update_ntuple(struct net_device_context *ndc, u32 loc,
+				const struct netvsc_ntuple_rule *new_rule)
+{
+	struct netvsc_ntuple_table *old = rtnl_dereference(ndc->ntuple);
+	struct netvsc_ntuple_table *tbl;
+	u32 i, cnt = old ? old->cnt : 0;
+	bool found = false;
+
+	tbl = kzalloc(sizeof(*tbl) + (cnt + 1) * sizeof(tbl->rules[0]),
+		      GFP_KERNEL);
+	if (!tbl)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		const struct netvsc_ntuple_rule *rule = &old->rules[i];
+
+		if (new_rule && !found && rule->fs.location > loc) {
+			tbl->rules[tbl->cnt++] = *new_rule;
+			found = true;
+		}
+
+		if (rule->fs.location == loc) {
+			found = true;
+			if (new_rule)
+				tbl->rules[tbl->cnt++] = *new_rule;
+			continue;
+		}
+
+		tbl->rules[tbl->cnt++] = *rule;
+	}
+
+	if (new_rule && !found)
+		tbl->rules[tbl->cnt++] = *new_rule;
+	else if (!new_rule && !found) {
+		kfree(tbl);
+		return -ENOENT;
+	}
+
+	if (tbl->cnt == 0) {
+		kfree(tbl);
+		tbl = NULL;
+	}
+
+	rcu_assign_pointer(ndc->ntuple, tbl);
+	if (old)
+		kfree_rcu(old, rcu);
+
+	return 0;
+}
+
+static int netvsc_add_ntuple(struct net_device_context *ndc,
+			     struct netvsc_device *nvdev,
+			     const struct ethtool_rx_flow_spec *fs)
+{
+	struct netvsc_ntuple_rule rule;
+
+	if (fs->location >= NETVSC_NTUPLE_MAX)
+		return -EINVAL;
+
+	memset(&rule, 0, sizeof(rule));
+	rule.fs = *fs;
+
+	/* Only IPv4 TCP/UDP address and port matches are supported */
+	switch (fs->flow_type) {
+	case TCP_V4_FLOW:
+		rule.proto = IPPROTO_TCP;
+		break;
+	case UDP_V4_FLOW:
+		rule.proto = IPPROTO_UDP;
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	if (fs->m_u.tcp_ip4_spec.tos)
+		return -EOPNOTSUPP;
+
+	if (fs->ring_cookie == RX_CLS_FLOW_DISC)
+		rule.queue = NETVSC_NTUPLE_DROP;
+	else if (fs->ring_cookie < nvdev->num_chn)
+		rule.queue = fs->ring_cookie;
+	else
+		return -EINVAL;
+
+	return netvsc_update_ntuple(ndc, fs->location, &rule);
+}
+
+static int
+netvsc_set_rxnfc(struct net_device *dev, struct ethtool_rxnfc *info)
+{
+	struct net_device_context *ndc = netdev_priv(dev);
+	struct netvsc_device *nvdev = rtnl_dereference(ndc->nvdev);
+
+	if (!nvdev)
+		return -ENODEV;
+
+	switch (info->cmd) {
+	case ETHTOOL_SRXCLSRLINS:
+		return netvsc_add_ntuple(ndc, nvdev, &info->fs);
+
+	case ETHTOOL_SRXCLSRLDEL:
+		return netvsc_update_ntuple(ndc, info->fs.location, NULL);
+	}
+	return -EOPNOTSUPP;
+}
+
+#ifdef CONFIG_RFS_ACCEL
+/*
+ * Accelerated RFS. The host spreads received packets over the channels
+ * by the Toeplitz hash and our indirection table, so a flow is moved to
+ * the queue serving its consumer's CPU by rewriting the flow's table
+ * bucket. Rewrites are collected and sent to the host in a single RSS
+ * parameter update at most every NETVSC_ARFS_INTERVAL.
+ */
+#define NETVSC_ARFS_INTERVAL	(HZ / 10)
+
+/* Host RSS hash of a received packet; skb->data is the network header */
+static bool netvsc_rx_hash(u8 *key, const struct sk_buff *skb, u32 *hash)
+{
+	unsigned int hlen = skb_headlen(skb);
+	__be32 dbuf[9];
+	int data_len;
+
+	if (skb->protocol == htons(ETH_P_IP)) {
+		const struct iphdr *iph = (const struct iphdr *)skb->data;
+
+		if (hlen < sizeof(struct iphdr) || iph->ihl < 5)
+			return false;
+
+		dbuf[0] = iph->saddr;
+		dbuf[1] = iph->daddr;
+		data_len = 8;
+
+		if (iph->protocol == IPPROTO_TCP && !ip_is_fragment(iph) &&
+		    hlen >= iph->ihl * 4 + sizeof(__be32)) {
+			dbuf[2] = *(__be32 *)(skb->data + iph->ihl * 4);
+			data_len = 12;
+		}
+	} else if (skb->protocol == htons(ETH_P_IPV6)) {
+		const struct ipv6hdr *ip6h = (const struct ipv6hdr *)skb->data;
+
+		if (hlen < sizeof(struct ipv6hdr))
+			return false;
+
+		memcpy(dbuf, &ip6h->saddr, 32);
+		data_len = 32;
+
+		if (ip6h->nexthdr == IPPROTO_TCP &&
+		    hlen >= sizeof(struct ipv6hdr) + sizeof(__be32)) {
+			dbuf[8] = *(__be32 *)(skb->data + sizeof(struct ipv6hdr));
+			data_len = 36;
+		}
+	} else {
+		return false;
+	}
+
+	*hash = comp_hash(key, NETVSC_HASH_KEYLEN, dbuf, data_len);
+	return true;
+}
+
+static int netvsc_rx_flow_steer(struct net_device *net,
+				const struct sk_buff *skb,
+				u16 rxq_index, u32 flow_id)
+{
+	struct net_device_context *ndc = netdev_priv(net);
+	struct netvsc_device *nvdev = rcu_dereference(ndc->nvdev);
+	unsigned long next = ndc->arfs_last + NETVSC_ARFS_INTERVAL;
+	struct rndis_device *rdev;
+	u32 hash, bucket;
+
+	if (!nvdev || nvdev->destroy || rxq_index >= nvdev->num_chn)
+		return -EINVAL;
+
+	rdev = nvdev->extension;
+	if (!rdev || !netvsc_rx_hash(rdev->rss_key, skb, &hash))
+		return -EPROTONOSUPPORT;
+
+	/* The filter id is the bucket; it never expires on its own */
+	bucket = hash & (ITAB_NUM - 1);
+	if (rdev->rx_table[bucket] == rxq_index)
+		return bucket;
+
+	spin_lock_bh(&ndc->arfs_lock);
+	ndc->arfs_queue[bucket] = rxq_index;
+	__set_bit(bucket, ndc->arfs_pending);
+	spin_unlock_bh(&ndc->arfs_lock);
+
+	schedule_delayed_work(&ndc->arfs_work, time_after(jiffies, next) ?
+			      0 : next - jiffies);
+
+	return bucket;
+}
+
+static void netvsc_arfs_work(struct work_struct *w)
+{
+	struct net_device_context *ndc
+		= container_of(w, struct net_device_context, arfs_work.work);
+	struct netvsc_device *nvdev;
+	struct rndis_device *rdev;
+	bool changed = false;
+	u32 i;
+
+	if (!rtnl_trylock()) {
+		schedule_delayed_work(&ndc->arfs_work, NETVSC_ARFS_INTERVAL);
+		return;
+	}
+
+	nvdev = rtnl_dereference(ndc->nvdev);
+	if (!nvdev || nvdev->destroy || !nvdev->extension)
+		goto out;
+
+	rdev = nvdev->extension;
+
+	spin_lock_bh(&ndc->arfs_lock);
+	for_each_set_bit(i, ndc->arfs_pending, ITAB_NUM) {
+		if (ndc->arfs_queue[i] >= nvdev->num_chn ||
+		    rdev->rx_table[i] == ndc->arfs_queue[i])
+			continue;
+
+		rdev->rx_table[i] = ndc->arfs_queue[i];
+		changed = true;
+	}
+	bitmap_zero(ndc->arfs_pending, ITAB_NUM);
+	spin_unlock_bh(&ndc->arfs_lock);
+
+	if (changed) {
+		rndis_filter_set_rss_param(rdev, rdev->rss_key);
+		ndc->arfs_last = jiffies;
+		this_cpu_inc(ndc->eth_stats->rx_arfs_updates);
+	}
+out:
+	rtnl_unlock();
+}
+
+static void netvsc_arfs_free(struct net_device *net)
+{
+	struct cpu_rmap *rmap = net->rx_cpu_rmap;
+
+	if (!rmap)
+		return;
+
+	net->rx_cpu_rmap = NULL;
+	synchronize_net();
+	free_cpu_rmap(rmap);
+}
+
+/*
+ * Map each CPU to the queue whose channel interrupts it; a NULL or
+ * single channel device just drops the map. RTNL held.
+ */
+void netvsc_arfs_setup(struct net_device *net, struct netvsc_device *nvdev)
+{
+	struct cpu_rmap *rmap;
+	u32 i;
+
+	netvsc_arfs_free(net);
+
+	if (!nvdev || nvdev->num_chn < 2)
+		return;
+
+	rmap = alloc_cpu_rmap(nvdev->num_chn, GFP_KERNEL);
+	if (!rmap)
+		return;
+
+	for (i = 0; i < nvdev->num_chn; i++) {
+		const struct vmbus_channel *channel
+			= nvdev->chan_table[i].channel;
+
+		cpu_rmap_add(rmap, &nvdev->chan_table[i]);
+		cpu_rmap_update(rmap, i,
+				cpumask_of(channel ? channel->target_cpu : 0));
+	}
+
+	net->rx_cpu_rmap = rmap;
+}
+#else
+void netvsc_arfs_setup(struct net_device *net, struct netvsc_device *nvdev)
+{
+}
+#endif
+
 #ifdef CONFIG_NET_POLL_CONTROLLER
 static void netvsc_poll_controller(struct net_device *dev)
 {
@@ -1544,6 +2057,7 @@ static const struct ethtool_ops ethtool_ops = {
 	.get_settings	= netvsc_get_settings,
 	.set_settings	= netvsc_set_settings,
 	.get_rxnfc	= netvsc_get_rxnfc,
+	.set_rxnfc	= netvsc_set_rxnfc,
 	.get_rxfh_indir_size = netvsc_rss_indir_size,
 #if (RHEL_RELEASE_CODE > RHEL_RELEASE_VERSION(7,1))
 	.get_rxfh_key_size = netvsc_get_rxfh_key_size,
@@ -1564,6 +2078,9 @@ static const struct net_device_ops device_ops = {
 	.ndo_set_mac_address =		netvsc_set_mac_addr,
 	.ndo_select_queue =		netvsc_select_queue,
 	.ndo_get_stats64 =		netvsc_get_stats64,
+#ifdef CONFIG_RFS_ACCEL
+	.ndo_rx_flow_steer =		netvsc_rx_flow_steer,
+#endif
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller =		netvsc_poll_controller,
 #endif
@@ -1931,12 +2448,21 @@ static int netvsc_probe(struct hv_device *dev,
 	spin_lock_init(&net_device_ctx->lock);
 	INIT_LIST_HEAD(&net_device_ctx->reconfig_events);
 	INIT_DELAYED_WORK(&net_device_ctx->vf_takeover, netvsc_vf_setup);
+#ifdef CONFIG_RFS_ACCEL
+	INIT_DELAYED_WORK(&net_device_ctx->arfs_work, netvsc_arfs_work);
+	spin_lock_init(&net_device_ctx->arfs_lock);
+	net->hw_features |= NETIF_F_NTUPLE;
+#endif
 
 	net_device_ctx->vf_stats
 		= netdev_alloc_pcpu_stats(struct netvsc_vf_pcpu_stats);
 	if (!net_device_ctx->vf_stats)
 		goto no_stats;
 
+	net_device_ctx->eth_stats = alloc_percpu(struct netvsc_ethtool_stats);
+	if (!net_device_ctx->eth_stats)
+		goto no_eth_stats;
+
 	net->netdev_ops = &device_ops;
 	net->ethtool_ops = &ethtool_ops;
 	SET_NETDEV_DEV(net, &dev->device);
@@ -1986,6 +2512,8 @@ static int netvsc_probe(struct hv_device *dev,
 register_failed:
 	rndis_filter_device_remove(dev, nvdev);
 rndis_failed:
+	free_percpu(net_device_ctx->eth_stats);
+no_eth_stats:
 	free_percpu(net_device_ctx->vf_stats);
 no_stats:
 	hv_set_drvdata(dev, NULL);
@@ -2025,10 +2553,17 @@ static int netvsc_remove(struct hv_device *dev)
 
 	rndis_filter_device_remove(dev,
 				   rtnl_dereference(ndev_ctx->nvdev));
+	kfree(rtnl_dereference(ndev_ctx->ntuple));
+#ifdef CONFIG_RFS_ACCEL
+	/* Receive is stopped; the work only ever trylocks RTNL */
+	cancel_delayed_work_sync(&ndev_ctx->arfs_work);
+#endif
+	netvsc_arfs_setup(net, NULL);
 	rtnl_unlock();
 
 	hv_set_drvdata(dev, NULL);
 
+	free_percpu(ndev_ctx->eth_stats);
 	free_percpu(ndev_ctx->vf_stats);
 	free_netdev(net);
 	return 0;
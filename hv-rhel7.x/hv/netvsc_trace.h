@@ -0,0 +1,75 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM netvsc
+
+#if !defined(_NETVSC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _NETVSC_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * RNDIS packet boundaries. These events are a stable interface for
+ * tracing tools: names and TP_PROTO arguments are kept across releases,
+ * so raw tracepoint users can rely on getting the channel and packet
+ * pointers in this order.
+ */
+
+TRACE_EVENT(rndis_recv,
+	TP_PROTO(const struct net_device *ndev,
+		 const struct vmbus_channel *channel,
+		 const struct vmpacket_descriptor *desc,
+		 const struct rndis_message *msg),
+	TP_ARGS(ndev, channel, desc, msg),
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(u16, queue)
+		__field(u32, relid)
+		__field(u32, msg_type)
+		__field(u32, msg_len)
+	),
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->queue	  = channel->offermsg.offer.sub_channel_index;
+		__entry->relid	  = channel->offermsg.child_relid;
+		__entry->msg_type = msg->ndis_msg_type;
+		__entry->msg_len  = msg->msg_len;
+	),
+	TP_printk("dev=%s q=%u relid=0x%x type=0x%x len=%u",
+		  __get_str(name), __entry->queue, __entry->relid,
+		  __entry->msg_type, __entry->msg_len)
+);
+
+TRACE_EVENT(rndis_send,
+	TP_PROTO(const struct net_device *ndev,
+		 const struct vmbus_channel *channel,
+		 const struct hv_netvsc_packet *packet,
+		 const struct nvsp_message *nvmsg),
+	TP_ARGS(ndev, channel, packet, nvmsg),
+	TP_STRUCT__entry(
+		__string(name, ndev->name)
+		__field(u16, queue)
+		__field(u32, relid)
+		__field(u32, section)
+		__field(u32, len)
+		__field(u8, pages)
+	),
+	TP_fast_assign(
+		__assign_str(name, ndev->name);
+		__entry->queue	 = packet->q_idx;
+		__entry->relid	 = channel->offermsg.child_relid;
+		__entry->section = packet->send_buf_index;
+		__entry->len	 = packet->total_data_buflen;
+		__entry->pages	 = packet->page_buf_cnt;
+	),
+	TP_printk("dev=%s q=%u relid=0x%x section=%u len=%u pages=%u",
+		  __get_str(name), __entry->queue, __entry->relid,
+		  __entry->section, __entry->len, __entry->pages)
+);
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE netvsc_trace
+#endif /* _NETVSC_TRACE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -35,7 +35,7 @@ static void rndis_set_multicast(struct work_struct *w);
 
 #define RNDIS_EXT_LEN PAGE_SIZE
 struct rndis_request {
-	struct list_head list_ent;
+	struct rcu_head rcu;
 	struct completion  wait_event;
 
 	struct rndis_message response_msg;
@@ -77,9 +77,6 @@ static struct rndis_device *get_rndis_device(void)
 	if (!device)
 		return NULL;
 
-	spin_lock_init(&device->request_lock);
-
-	INIT_LIST_HEAD(&device->req_list);
 	INIT_WORK(&device->mcast_work, rndis_set_multicast);
 
 	device->state = RNDIS_DEV_UNINITIALIZED;
@@ -94,7 +91,8 @@ static struct rndis_request *get_rndis_request(struct rndis_device *dev,
 	struct rndis_request *request;
 	struct rndis_message *rndis_msg;
 	struct rndis_set_request *set;
-	unsigned long flags;
+	u32 id;
+	int i;
 
 	request = kzalloc(sizeof(struct rndis_request), GFP_KERNEL);
 	if (!request)
@@ -114,26 +112,35 @@ static struct rndis_request *get_rndis_request(struct rndis_device *dev,
 	 * template
 	 */
 	set = &rndis_msg->msg.set_req;
-	set->req_id = atomic_inc_return(&dev->new_req_id);
 
-	/* Add to the request list */
-	spin_lock_irqsave(&dev->request_lock, flags);
-	list_add_tail(&request->list_ent, &dev->req_list);
-	spin_unlock_irqrestore(&dev->request_lock, flags);
+	/*
+	 * Claim the table slot picked by the id, so the response can be
+	 * matched without a lock or a list walk. If that slot still holds a
+	 * request in flight, move on to the next id.
+	 */
+	for (i = 0; i < RNDIS_MAX_REQS; i++) {
+		id = atomic_inc_return(&dev->new_req_id);
+		set->req_id = id;
 
-	return request;
+		if (!cmpxchg(&dev->req_table[id & (RNDIS_MAX_REQS - 1)],
+			     NULL, request))
+			return request;
+	}
+
+	netdev_err(dev->ndev, "too many outstanding rndis requests\n");
+	kfree(request);
+	return NULL;
 }
 
 static void put_rndis_request(struct rndis_device *dev,
 			    struct rndis_request *req)
 {
-	unsigned long flags;
+	u32 id = req->request_msg.msg.set_req.req_id;
 
-	spin_lock_irqsave(&dev->request_lock, flags);
-	list_del(&req->list_ent);
-	spin_unlock_irqrestore(&dev->request_lock, flags);
+	WRITE_ONCE(dev->req_table[id & (RNDIS_MAX_REQS - 1)], NULL);
 
-	kfree(req);
+	/* A late or duplicate response may still be looking at it */
+	kfree_rcu(req, rcu);
 }
 
 static void dump_rndis_message(struct net_device *netdev,
@@ -271,26 +278,15 @@ static void rndis_set_link_state(struct rndis_device *rdev,
 static void rndis_filter_receive_response(struct rndis_device *dev,
 				       struct rndis_message *resp)
 {
-	struct rndis_request *request = NULL;
-	bool found = false;
-	unsigned long flags;
+	struct rndis_request *request;
 	struct net_device *ndev = dev->ndev;
+	/* All request/response message contains RequestId as the 1st field */
+	u32 id = resp->msg.init_complete.req_id;
 
-	spin_lock_irqsave(&dev->request_lock, flags);
-	list_for_each_entry(request, &dev->req_list, list_ent) {
-		/*
-		 * All request/response message contains RequestId as the 1st
-		 * field
-		 */
-		if (request->request_msg.msg.init_req.req_id
-		    == resp->msg.init_complete.req_id) {
-			found = true;
-			break;
-		}
-	}
-	spin_unlock_irqrestore(&dev->request_lock, flags);
+	rcu_read_lock();
+	request = READ_ONCE(dev->req_table[id & (RNDIS_MAX_REQS - 1)]);
 
-	if (found) {
+	if (request && request->request_msg.msg.init_req.req_id == id) {
 		if (resp->msg_len <=
 		    sizeof(struct rndis_message) + RNDIS_EXT_LEN) {
 			memcpy(&request->response_msg, resp,
@@ -326,6 +322,7 @@ static void rndis_filter_receive_response(struct rndis_device *dev,
 			resp->msg.init_complete.req_id,
 			resp->ndis_msg_type);
 	}
+	rcu_read_unlock();
 }
 
 /*
@@ -450,26 +447,23 @@ int rndis_filter_receive(struct net_device *ndev,
 	return 0;
 }
 
-static int rndis_filter_query_device(struct rndis_device *dev,
-				     struct netvsc_device *nvdev,
-				     u32 oid, void *result, u32 *result_size)
+/*
+ * Build and send a query without waiting for the answer, so that several
+ * independent queries can be in flight at once. Every request returned
+ * here has to be passed to rndis_filter_query_finish().
+ */
+static struct rndis_request *
+rndis_filter_query_start(struct rndis_device *dev,
+			 struct netvsc_device *nvdev, u32 oid)
 {
 	struct rndis_request *request;
-	u32 inresult_size = *result_size;
 	struct rndis_query_request *query;
-	struct rndis_query_complete *query_complete;
-	int ret = 0;
-
-	if (!result)
-		return -EINVAL;
+	int ret;
 
-	*result_size = 0;
 	request = get_rndis_request(dev, RNDIS_MSG_QUERY,
 			RNDIS_MESSAGE_SIZE(struct rndis_query_request));
-	if (!request) {
-		ret = -ENOMEM;
-		goto cleanup;
-	}
+	if (!request)
+		return ERR_PTR(-ENOMEM);
 
 	/* Setup the rndis query */
 	query = &request->request_msg.msg.query_req;
@@ -518,8 +512,26 @@ static int rndis_filter_query_device(struct rndis_device *dev,
 	}
 
 	ret = rndis_filter_send_request(dev, request);
-	if (ret != 0)
-		goto cleanup;
+	if (ret != 0) {
+		put_rndis_request(dev, request);
+		return ERR_PTR(ret);
+	}
+
+	return request;
+}
+
+/* Wait for a query sent by rndis_filter_query_start() and release it */
+static int rndis_filter_query_finish(struct rndis_device *dev,
+				     struct rndis_request *request,
+				     void *result, u32 *result_size)
+{
+	u32 inresult_size = *result_size;
+	struct rndis_query_complete *query_complete;
+	int ret = 0;
+
+	*result_size = 0;
+	if (IS_ERR(request))
+		return PTR_ERR(request);
 
 	wait_for_completion(&request->wait_event);
 
@@ -539,28 +551,16 @@ static int rndis_filter_query_device(struct rndis_device *dev,
 	*result_size = query_complete->info_buflen;
 
 cleanup:
-	if (request)
-		put_rndis_request(dev, request);
+	put_rndis_request(dev, request);
 
 	return ret;
 }
 
-/* Get the hardware offload capabilities */
+/* Validate the hardware offload capabilities returned by the host */
 static int
-rndis_query_hwcaps(struct rndis_device *dev, struct netvsc_device *net_device,
-		   struct ndis_offload *caps)
+rndis_check_hwcaps(struct rndis_device *dev, const struct ndis_offload *caps,
+		   u32 caps_len)
 {
-	u32 caps_len = sizeof(*caps);
-	int ret;
-
-	memset(caps, 0, sizeof(*caps));
-
-	ret = rndis_filter_query_device(dev, net_device,
-					OID_TCP_OFFLOAD_HARDWARE_CAPABILITIES,
-					caps, &caps_len);
-	if (ret)
-		return ret;
-
 	if (caps->header.type != NDIS_OBJECT_TYPE_OFFLOAD) {
 		netdev_warn(dev->ndev, "invalid NDIS objtype %#x\n",
 			    caps->header.type);
@@ -584,16 +584,6 @@ rndis_query_hwcaps(struct rndis_device *dev, struct netvsc_device *net_device,
 	return 0;
 }
 
-static int rndis_filter_query_device_mac(struct rndis_device *dev,
-					 struct netvsc_device *net_device)
-{
-	u32 size = ETH_ALEN;
-
-	return rndis_filter_query_device(dev, net_device,
-				      RNDIS_OID_802_3_PERMANENT_ADDRESS,
-				      dev->hw_mac_adr, &size);
-}
-
 #define NWADR_STR "NetworkAddress"
 #define NWADR_STRLEN 14
 
@@ -787,41 +777,6 @@ cleanup:
 	return ret;
 }
 
-static int rndis_filter_query_device_link_status(struct rndis_device *dev,
-						 struct netvsc_device *net_device)
-{
-	u32 size = sizeof(u32);
-	u32 link_status;
-
-	return rndis_filter_query_device(dev, net_device,
-					 RNDIS_OID_GEN_MEDIA_CONNECT_STATUS,
-					 &link_status, &size);
-}
-
-static int rndis_filter_query_link_speed(struct rndis_device *dev,
-					 struct netvsc_device *net_device)
-{
-	u32 size = sizeof(u32);
-	u32 link_speed;
-	struct net_device_context *ndc;
-	int ret;
-
-	ret = rndis_filter_query_device(dev, net_device,
-					RNDIS_OID_GEN_LINK_SPEED,
-					&link_speed, &size);
-
-	if (!ret) {
-		ndc = netdev_priv(dev->ndev);
-
-		/* The link speed reported from host is in 100bps unit, so
-		 * we convert it to Mbps here.
-		 */
-		ndc->speed = link_speed / 10000;
-	}
-
-	return ret;
-}
-
 static int rndis_filter_set_packet_filter(struct rndis_device *dev,
 					  u32 new_filter)
 {
@@ -854,19 +809,93 @@ static int rndis_filter_set_packet_filter(struct rndis_device *dev,
 	return ret;
 }
 
+/* Program the list of multicast addresses the host should pass to us */
+static int rndis_filter_set_mcast_list(struct rndis_device *dev,
+				       const u8 *addrs, u32 count)
+{
+	struct rndis_request *request;
+	struct rndis_set_request *set;
+	struct rndis_set_complete *set_complete;
+	u32 extlen = count * ETH_ALEN;
+	int ret;
+
+	request = get_rndis_request(dev, RNDIS_MSG_SET,
+			RNDIS_MESSAGE_SIZE(struct rndis_set_request) + extlen);
+	if (!request)
+		return -ENOMEM;
+
+	set = &request->request_msg.msg.set_req;
+	set->oid = RNDIS_OID_802_3_MULTICAST_LIST;
+	set->info_buflen = extlen;
+	set->info_buf_offset = sizeof(struct rndis_set_request);
+	set->dev_vc_handle = 0;
+
+	if (extlen)
+		memcpy(set + 1, addrs, extlen);
+
+	ret = rndis_filter_send_request(dev, request);
+	if (ret != 0)
+		goto cleanup;
+
+	wait_for_completion(&request->wait_event);
+	set_complete = &request->response_msg.msg.set_complete;
+	if (set_complete->status != RNDIS_STATUS_SUCCESS)
+		ret = -EIO;
+
+cleanup:
+	put_rndis_request(dev, request);
+	return ret;
+}
+
 static void rndis_set_multicast(struct work_struct *w)
 {
 	struct rndis_device *rdev
 		= container_of(w, struct rndis_device, mcast_work);
+	struct net_device *ndev = rdev->ndev;
+	struct netdev_hw_addr *ha;
+	u32 filter = NDIS_PACKET_TYPE_BROADCAST | NDIS_PACKET_TYPE_DIRECTED;
+	bool use_list = false;
+	u8 *addrs = NULL;
+	u32 count = 0;
 
-	if (rdev->ndev->flags & IFF_PROMISC)
+	if (ndev->flags & IFF_PROMISC) {
 		rndis_filter_set_packet_filter(rdev,
 					       NDIS_PACKET_TYPE_PROMISCUOUS);
-	else
-		rndis_filter_set_packet_filter(rdev,
-					       NDIS_PACKET_TYPE_BROADCAST |
-					       NDIS_PACKET_TYPE_ALL_MULTICAST |
-					       NDIS_PACKET_TYPE_DIRECTED);
+		return;
+	}
+
+	/*
+	 * Let the host filter multicast when it has a list and the groups
+	 * fit in it; receiving all multicast is only the fallback. A host
+	 * that reported no list size never sees the list OID.
+	 */
+	netif_addr_lock_bh(ndev);
+	if (rdev->mcast_max && !(ndev->flags & IFF_ALLMULTI) &&
+	    netdev_mc_count(ndev) <= rdev->mcast_max) {
+		use_list = true;
+		if (!netdev_mc_empty(ndev)) {
+			addrs = kmalloc(netdev_mc_count(ndev) * ETH_ALEN,
+					GFP_ATOMIC);
+			if (addrs) {
+				netdev_for_each_mc_addr(ha, ndev)
+					memcpy(addrs + ETH_ALEN * count++,
+					       ha->addr, ETH_ALEN);
+			} else {
+				use_list = false;
+			}
+		}
+	}
+	netif_addr_unlock_bh(ndev);
+
+	if (!use_list)
+		filter |= NDIS_PACKET_TYPE_ALL_MULTICAST;
+	else if (rndis_filter_set_mcast_list(rdev, addrs, count) != 0)
+		filter |= NDIS_PACKET_TYPE_ALL_MULTICAST;
+	else if (count)
+		filter |= NDIS_PACKET_TYPE_MULTICAST;
+
+	kfree(addrs);
+	rndis_filter_set_packet_filter(rdev, filter);
 }
 
 void rndis_filter_update(struct netvsc_device *nvdev)
@@ -947,7 +976,6 @@ static bool netvsc_device_idle(const struct netvsc_device *nvdev)
 static void rndis_filter_halt_device(struct rndis_device *dev)
 {
 	struct rndis_request *request;
-	struct rndis_halt_request *halt;
 	struct net_device_context *net_device_ctx = netdev_priv(dev->ndev);
 	struct netvsc_device *nvdev = rtnl_dereference(net_device_ctx->nvdev);
 
@@ -957,10 +985,6 @@ static void rndis_filter_halt_device(struct rndis_device *dev)
 	if (!request)
 		goto cleanup;
 
-	/* Setup the rndis set */
-	halt = &request->request_msg.msg.halt_req;
-	halt->req_id = atomic_inc_return(&dev->new_req_id);
-
 	/* Ignore return since this msg is optional. */
 	rndis_filter_send_request(dev, request);
 
@@ -1117,6 +1141,7 @@ void rndis_set_subchannel(struct work_struct *w)
 
 	netif_set_real_num_tx_queues(ndev, nvdev->num_chn);
 	netif_set_real_num_rx_queues(ndev, nvdev->num_chn);
+	netvsc_arfs_setup(ndev, nvdev);
 
 	for (i = 0; i < VRSS_SEND_TAB_SIZE; i++)
 		ndev_ctx->tx_table[i] = i % nvdev->num_chn;
@@ -1136,20 +1161,15 @@ unlock:
 }
 
 static int rndis_netdev_set_hwcaps(struct rndis_device *rndis_device,
-				   struct netvsc_device *nvdev)
+				   struct netvsc_device *nvdev,
+				   const struct ndis_offload *hwcaps)
 {
 	struct net_device *net = rndis_device->ndev;
 	struct net_device_context *net_device_ctx = netdev_priv(net);
-	struct ndis_offload hwcaps;
 	struct ndis_offload_params offloads;
 	unsigned int gso_max_size = GSO_MAX_SIZE;
 	int ret;
 
-	/* Find HW offload capabilities */
-	ret = rndis_query_hwcaps(rndis_device, nvdev, &hwcaps);
-	if (ret != 0)
-		return ret;
-
 	/* A value of zero means "no change"; now turn on what we want. */
 	memset(&offloads, 0, sizeof(struct ndis_offload_params));
 
@@ -1163,43 +1183,43 @@ static int rndis_netdev_set_hwcaps(struct rndis_device *rndis_device,
 	/* Compute tx offload settings based on hw capabilities */
 	net->hw_features |= NETIF_F_RXCSUM;
 
-	if ((hwcaps.csum.ip4_txcsum & NDIS_TXCSUM_ALL_TCP4) == NDIS_TXCSUM_ALL_TCP4) {
+	if ((hwcaps->csum.ip4_txcsum & NDIS_TXCSUM_ALL_TCP4) == NDIS_TXCSUM_ALL_TCP4) {
 		/* Can checksum TCP */
 		net->hw_features |= NETIF_F_IP_CSUM;
 		net_device_ctx->tx_checksum_mask |= TRANSPORT_INFO_IPV4_TCP;
 
 		offloads.tcp_ip_v4_csum = NDIS_OFFLOAD_PARAMETERS_TX_RX_ENABLED;
 
-		if (hwcaps.lsov2.ip4_encap & NDIS_OFFLOAD_ENCAP_8023) {
+		if (hwcaps->lsov2.ip4_encap & NDIS_OFFLOAD_ENCAP_8023) {
 			offloads.lso_v2_ipv4 = NDIS_OFFLOAD_PARAMETERS_LSOV2_ENABLED;
 			net->hw_features |= NETIF_F_TSO;
 
-			if (hwcaps.lsov2.ip4_maxsz < gso_max_size)
-				gso_max_size = hwcaps.lsov2.ip4_maxsz;
+			if (hwcaps->lsov2.ip4_maxsz < gso_max_size)
+				gso_max_size = hwcaps->lsov2.ip4_maxsz;
 		}
 
-		if (hwcaps.csum.ip4_txcsum & NDIS_TXCSUM_CAP_UDP4) {
+		if (hwcaps->csum.ip4_txcsum & NDIS_TXCSUM_CAP_UDP4) {
 			offloads.udp_ip_v4_csum = NDIS_OFFLOAD_PARAMETERS_TX_RX_ENABLED;
 			net_device_ctx->tx_checksum_mask |= TRANSPORT_INFO_IPV4_UDP;
 		}
 	}
 
-	if ((hwcaps.csum.ip6_txcsum & NDIS_TXCSUM_ALL_TCP6) == NDIS_TXCSUM_ALL_TCP6) {
+	if ((hwcaps->csum.ip6_txcsum & NDIS_TXCSUM_ALL_TCP6) == NDIS_TXCSUM_ALL_TCP6) {
 		net->hw_features |= NETIF_F_IPV6_CSUM;
 
 		offloads.tcp_ip_v6_csum = NDIS_OFFLOAD_PARAMETERS_TX_RX_ENABLED;
 		net_device_ctx->tx_checksum_mask |= TRANSPORT_INFO_IPV6_TCP;
 
-		if ((hwcaps.lsov2.ip6_encap & NDIS_OFFLOAD_ENCAP_8023) &&
-		    (hwcaps.lsov2.ip6_opts & NDIS_LSOV2_CAP_IP6) == NDIS_LSOV2_CAP_IP6) {
+		if ((hwcaps->lsov2.ip6_encap & NDIS_OFFLOAD_ENCAP_8023) &&
+		    (hwcaps->lsov2.ip6_opts & NDIS_LSOV2_CAP_IP6) == NDIS_LSOV2_CAP_IP6) {
 			offloads.lso_v2_ipv6 = NDIS_OFFLOAD_PARAMETERS_LSOV2_ENABLED;
 			net->hw_features |= NETIF_F_TSO6;
 
-			if (hwcaps.lsov2.ip6_maxsz < gso_max_size)
-				gso_max_size = hwcaps.lsov2.ip6_maxsz;
+			if (hwcaps->lsov2.ip6_maxsz < gso_max_size)
+				gso_max_size = hwcaps->lsov2.ip6_maxsz;
 		}
 
-		if (hwcaps.csum.ip6_txcsum & NDIS_TXCSUM_CAP_UDP6) {
+		if (hwcaps->csum.ip6_txcsum & NDIS_TXCSUM_CAP_UDP6) {
 			offloads.udp_ip_v6_csum = NDIS_OFFLOAD_PARAMETERS_TX_RX_ENABLED;
 			net_device_ctx->tx_checksum_mask |= TRANSPORT_INFO_IPV6_UDP;
 		}
@@ -1223,12 +1243,17 @@ struct netvsc_device *rndis_filter_device_add(struct hv_device *dev,
 	struct net_device *net = hv_get_drvdata(dev);
 	struct netvsc_device *net_device;
 	struct rndis_device *rndis_device;
+	struct net_device_context *ndc = netdev_priv(net);
+	struct rndis_request *mtu_req, *mac_req, *hwcaps_req, *link_req;
+	struct rndis_request *mcast_req;
+	struct rndis_request *speed_req = NULL, *rsscap_req = NULL;
+	struct ndis_offload hwcaps;
 	struct ndis_recv_scale_cap rsscap;
 	u32 rsscap_size = sizeof(struct ndis_recv_scale_cap);
-	u32 mtu, size;
+	u32 mtu, link_status, link_speed, mcast_max, size;
 	const struct cpumask *node_cpu_mask;
 	u32 num_possible_rss_qs;
-	int i, ret;
+	int i, ret, mac_ret, hwcaps_ret, rsscap_ret = -EOPNOTSUPP;
 
 	rndis_device = get_rndis_device();
 	if (!rndis_device)
@@ -1256,28 +1281,93 @@ struct netvsc_device *rndis_filter_device_add(struct hv_device *dev,
 	if (ret != 0)
 		goto err_dev_remv;
 
+	/*
+	 * None of the queries below depends on the answer to another, so
+	 * they are all sent before waiting on the first one; bring-up then
+	 * costs one host round trip instead of one per OID.
+	 */
+	mtu_req = rndis_filter_query_start(rndis_device, net_device,
+					   RNDIS_OID_GEN_MAXIMUM_FRAME_SIZE);
+	mac_req = rndis_filter_query_start(rndis_device, net_device,
+					   RNDIS_OID_802_3_PERMANENT_ADDRESS);
+	hwcaps_req = rndis_filter_query_start(rndis_device, net_device,
+					OID_TCP_OFFLOAD_HARDWARE_CAPABILITIES);
+	link_req = rndis_filter_query_start(rndis_device, net_device,
+					    RNDIS_OID_GEN_MEDIA_CONNECT_STATUS);
+	mcast_req = rndis_filter_query_start(rndis_device, net_device,
+					RNDIS_OID_802_3_MAXIMUM_LIST_SIZE);
+	if (net_device->nvsp_version >= NVSP_PROTOCOL_VERSION_5) {
+		speed_req = rndis_filter_query_start(rndis_device, net_device,
+						     RNDIS_OID_GEN_LINK_SPEED);
+		rsscap_req = rndis_filter_query_start(rndis_device, net_device,
+					OID_GEN_RECEIVE_SCALE_CAPABILITIES);
+	}
+
 	/* Get the MTU from the host */
 	size = sizeof(u32);
-	ret = rndis_filter_query_device(rndis_device, net_device,
-					RNDIS_OID_GEN_MAXIMUM_FRAME_SIZE,
-					&mtu, &size);
+	ret = rndis_filter_query_finish(rndis_device, mtu_req, &mtu, &size);
 	if (ret == 0 && size == sizeof(u32) && mtu < net->mtu)
 		net->mtu = mtu;
 
 	/* Get the mac address */
-	ret = rndis_filter_query_device_mac(rndis_device, net_device);
+	size = ETH_ALEN;
+	mac_ret = rndis_filter_query_finish(rndis_device, mac_req,
+					    rndis_device->hw_mac_adr, &size);
+
+	/* Find HW offload capabilities */
+	memset(&hwcaps, 0, sizeof(hwcaps));
+	size = sizeof(hwcaps);
+	hwcaps_ret = rndis_filter_query_finish(rndis_device, hwcaps_req,
+					       &hwcaps, &size);
+	if (hwcaps_ret == 0)
+		hwcaps_ret = rndis_check_hwcaps(rndis_device, &hwcaps, size);
+
+	/* The link state is recorded by rndis_filter_receive_response() */
+	size = sizeof(u32);
+	rndis_filter_query_finish(rndis_device, link_req, &link_status, &size);
+
+	/*
+	 * Without a multicast list all multicast traffic is received. The
+	 * list has to fit in a single request message.
+	 */
+	size = sizeof(u32);
+	ret = rndis_filter_query_finish(rndis_device, mcast_req,
+					&mcast_max, &size);
+	if (ret == 0 && size == sizeof(u32))
+		rndis_device->mcast_max = min_t(u32, mcast_max,
+						RNDIS_EXT_LEN / ETH_ALEN);
+
+	if (speed_req) {
+		size = sizeof(u32);
+		ret = rndis_filter_query_finish(rndis_device, speed_req,
+						&link_speed, &size);
+		/* The link speed reported from host is in 100bps unit, so
+		 * we convert it to Mbps here.
+		 */
+		if (ret == 0)
+			ndc->speed = link_speed / 10000;
+	}
+
+	memset(&rsscap, 0, rsscap_size);
+	if (rsscap_req)
+		rsscap_ret = rndis_filter_query_finish(rndis_device, rsscap_req,
+						       &rsscap, &rsscap_size);
+
+	/* Nothing is in flight anymore, so failures can bail out now */
+	ret = mac_ret;
 	if (ret != 0)
 		goto err_dev_remv;
 
 	memcpy(device_info->mac_adr, rndis_device->hw_mac_adr, ETH_ALEN);
 
-	/* Query and set hardware capabilities */
-	ret = rndis_netdev_set_hwcaps(rndis_device, net_device);
+	/* Set hardware capabilities */
+	ret = hwcaps_ret;
+	if (ret == 0)
+		ret = rndis_netdev_set_hwcaps(rndis_device, net_device,
+					      &hwcaps);
 	if (ret != 0)
 		goto err_dev_remv;
 
-	rndis_filter_query_device_link_status(rndis_device, net_device);
-
 	netdev_dbg(net, "Device MAC %pM link state %s\n",
 		   rndis_device->hw_mac_adr,
 		   rndis_device->link_state ? "down" : "up");
@@ -1285,13 +1375,8 @@ struct netvsc_device *rndis_filter_device_add(struct hv_device *dev,
 	if (net_device->nvsp_version < NVSP_PROTOCOL_VERSION_5)
 		return net_device;
 
-	rndis_filter_query_link_speed(rndis_device, net_device);
-
 	/* vRSS setup */
-	memset(&rsscap, 0, rsscap_size);
-	ret = rndis_filter_query_device(rndis_device, net_device,
-					OID_GEN_RECEIVE_SCALE_CAPABILITIES,
-					&rsscap, &rsscap_size);
+	ret = rsscap_ret;
 	if (ret || rsscap.num_recv_que < 2)
 		goto out;
 
@@ -399,6 +399,11 @@ enum storvsc_request_type {
  * This is the end of Protocol specific defines.
  */
 
+struct storvsc_cmd_request;
+
+#define CREATE_TRACE_POINTS
+#include "storvsc_trace.h"
+
 
 /*
  * We setup a mempool to allocate request structures for this driver
@@ -417,6 +422,20 @@ MODULE_PARM_DESC(storvsc_ringbuffer_size, "Ring buffer size (bytes)");
 
 module_param(storvsc_vcpus_per_sub_channel, int, S_IRUGO);
 MODULE_PARM_DESC(storvsc_vcpus_per_sub_channel, "Ratio of VCPUs to subchannels");
+
+/*
+ * Both only change what the caching mode page returned by the host says;
+ * sd then picks the flush and FUA behaviour from it as for any disk.
+ */
+static bool storvsc_fua;
+module_param(storvsc_fua, bool, S_IRUGO);
+MODULE_PARM_DESC(storvsc_fua,
+	"Report FUA support (DPOFUA) even if the host does not");
+
+static bool storvsc_write_through;
+module_param(storvsc_write_through, bool, S_IRUGO);
+MODULE_PARM_DESC(storvsc_write_through,
+	"Backing storage has no volatile cache: report write-through, no cache flushes are sent");
 /*
  * Timeout in seconds for all devices managed by this driver.
  */
@@ -515,9 +534,18 @@ struct storvsc_device {
 #endif
 };
 
+/*
+ * Special handling of a SCSI opcode, precomputed per LUN so that the
+ * I/O path does a single table lookup instead of comparing opcodes.
+ */
+#define STORVSC_CMD_REJECT	0x01	/* fail without sending to the host */
+#define STORVSC_CMD_FIX_STATUS	0x02	/* host errors are not fatal */
+#define STORVSC_CMD_FIX_DATA	0x04	/* storvsc_fixup_data() on completion */
+
 struct stor_mem_pools {
 	struct kmem_cache *request_pool;
 	mempool_t *request_mempool;
+	u8 cmd_flags[256];
 };
 
 struct hv_host_device {
@@ -1304,6 +1332,95 @@ static void storvsc_handle_error(struct vmscsi_request *vm_srb,
 }
 
 
+/*
+ * Apply storvsc_fua and storvsc_write_through to a MODE SENSE response.
+ * Only the first data segment is looked at; sd reads the caching page
+ * into a single small buffer.
+ */
+static void storvsc_fixup_mode_sense(struct scsi_cmnd *scmnd, u32 len)
+{
+	struct scatterlist *sgl = scsi_sglist(scmnd);
+	unsigned int hdr_len, bd_len, dev_spec, p;
+	u8 *data;
+
+	if (!sgl)
+		return;
+
+	len = min3(len, sgl->length, (u32)(PAGE_SIZE - sgl->offset));
+	data = kmap_atomic(sg_page(sgl)) + sgl->offset;
+
+	if (scmnd->cmnd[0] == MODE_SENSE) {
+		hdr_len = 4;
+		dev_spec = 2;
+		bd_len = len >= hdr_len ? data[3] : 0;
+	} else {
+		hdr_len = 8;
+		dev_spec = 3;
+		bd_len = len >= hdr_len ? (data[6] << 8) | data[7] : 0;
+	}
+
+	if (len < hdr_len)
+		goto out;
+
+	/* DPOFUA; the FUA bit of WRITE CDBs is passed to the host as is */
+	if (storvsc_fua)
+		data[dev_spec] |= 0x10;
+
+	/* Clear WCE in the caching page (0x08) */
+	for (p = hdr_len + bd_len; storvsc_write_through && p + 3 <= len;
+	     p += data[p + 1] + 2) {
+		if ((data[p] & 0x3f) == 0x08) {
+			data[p + 2] &= ~0x04;
+			break;
+		}
+	}
+
+out:
+	kunmap_atomic((void *)data - sgl->offset);
+}
+
+static void storvsc_fixup_inquiry(struct scsi_cmnd *scmnd)
+{
+	/* If this is an INQUIRY when SCSI is trying to probe a LUN, return a proper 
+	 * SCSI level and vendor/device names to trigger REPORT_LUNS scan
+	 * note: on probing LUN0, SCSI sets all the fields  to zero except for the length at [4]
+	 * the SCSI layer expects at least 36 bytes returned on INQUIRY response
+	 */
+	if (!(scmnd->cmnd[1] | scmnd->cmnd[2] | scmnd->cmnd[3] | scmnd->cmnd[5])
+	    && scsi_bufflen(scmnd) >= 32) {
+
+		struct scatterlist *sgl = scsi_sglist(scmnd);
+		char *data = kmap_atomic(sg_page(sgl)) + sgl->offset;
+
+		/* if the host doesn't return any data (0 length), set them properly */
+		if (!data[4]) {
+			/* if host doesn't return SCSI level, set to SCSI_2 minimal required for REPORT_LUNS */
+			if (!data[2])
+				data[2] = SCSI_2;
+
+			sprintf(&data[8], "MSFT"); 	// vendor name, max 8 bytes
+			sprintf(&data[16], "LUN");	// device name, max 16 bytes
+		}
+
+		kunmap_atomic((void *)data - sgl->offset);
+	}
+}
+
+/* Completion hook for the opcodes flagged STORVSC_CMD_FIX_DATA */
+static void storvsc_fixup_data(struct scsi_cmnd *scmnd, u32 len)
+{
+	switch (scmnd->cmnd[0]) {
+	case INQUIRY:
+		storvsc_fixup_inquiry(scmnd);
+		break;
+	case MODE_SENSE:
+	case MODE_SENSE_10:
+		if (!scmnd->result && len)
+			storvsc_fixup_mode_sense(scmnd, len);
+		break;
+	}
+}
+
 static void storvsc_command_completion(struct storvsc_cmd_request *cmd_request,
 				       struct storvsc_device *stor_dev)
 {
@@ -1363,30 +1480,8 @@ static void storvsc_command_completion(struct storvsc_cmd_request *cmd_request,
 	scsi_set_resid(scmnd,
 		cmd_request->payload->range.len - data_transfer_length);
 
-	/* If this is an INQUIRY when SCSI is trying to probe a LUN, return a proper 
-	 * SCSI level and vendor/device names to trigger REPORT_LUNS scan
-	 * note: on probing LUN0, SCSI sets all the fields  to zero except for the length at [4]
-	 * the SCSI layer expects at least 36 bytes returned on INQUIRY response
-	 */
-	if (scmnd->cmnd[0] == INQUIRY
-	    && !(scmnd->cmnd[1] | scmnd->cmnd[2] | scmnd->cmnd[3] | scmnd->cmnd[5])
-	    && scsi_bufflen(scmnd) >= 32) {
-
-		struct scatterlist *sgl = scsi_sglist(scmnd);
-		char *data = kmap_atomic(sg_page(sgl)) + sgl->offset;
-
-		/* if the host doesn't return any data (0 length), set them properly */
-		if (!data[4]) {
-			/* if host doesn't return SCSI level, set to SCSI_2 minimal required for REPORT_LUNS */
-			if (!data[2])
-				data[2] = SCSI_2;
-
-			sprintf(&data[8], "MSFT"); 	// vendor name, max 8 bytes
-			sprintf(&data[16], "LUN");	// device name, max 16 bytes
-		}
-
-		kunmap_atomic((void *)data - sgl->offset);
-	}
+	if (unlikely(memp->cmd_flags[scmnd->cmnd[0]] & STORVSC_CMD_FIX_DATA))
+		storvsc_fixup_data(scmnd, data_transfer_length);
 
 	scsi_done_fn = scmnd->scsi_done;
 
@@ -1408,6 +1503,7 @@ static void storvsc_on_io_completion(struct storvsc_device *stor_device,
 {
 	struct vstor_packet *stor_pkt;
 	struct hv_device *device = stor_device->device;
+	struct stor_mem_pools *memp = request->cmd->device->hostdata;
 
 	stor_pkt = &request->vstor_packet;
 
@@ -1422,8 +1518,8 @@ static void storvsc_on_io_completion(struct storvsc_device *stor_device,
 	 * (srb status == 0x4) and off-line the device in that case.
 	 */
 
-	if ((stor_pkt->vm_srb.cdb[0] == INQUIRY) ||
-	   (stor_pkt->vm_srb.cdb[0] == MODE_SENSE)) {
+	if (unlikely(memp->cmd_flags[stor_pkt->vm_srb.cdb[0]] &
+		     STORVSC_CMD_FIX_STATUS)) {
 		vstor_packet->vm_srb.scsi_status = 0;
 		vstor_packet->vm_srb.srb_status = SRB_STATUS_SUCCESS;
 	}
@@ -1435,8 +1531,8 @@ static void storvsc_on_io_completion(struct storvsc_device *stor_device,
 	stor_pkt->vm_srb.sense_info_length =
 	vstor_packet->vm_srb.sense_info_length;
 
-	if (vstor_packet->vm_srb.scsi_status != 0 ||
-	    vstor_packet->vm_srb.srb_status != SRB_STATUS_SUCCESS)
+	if (unlikely(vstor_packet->vm_srb.scsi_status != 0 ||
+		     vstor_packet->vm_srb.srb_status != SRB_STATUS_SUCCESS))
 		storvsc_log(device, STORVSC_LOGGING_WARN,
 			"cmd 0x%x scsi status 0x%x srb status 0x%x\n",
 			stor_pkt->vm_srb.cdb[0],
@@ -1529,6 +1625,7 @@ static void storvsc_on_channel_callback(void *context)
 			       (sizeof(struct vstor_packet) - vmscsi_size_delta));
 			complete(&request->wait_event);
 		} else {
+			trace_storvsc_srb_complete(channel, desc, packet);
 			storvsc_on_receive(stor_device, packet, request);
 		}
 	}
@@ -1695,6 +1792,8 @@ static int storvsc_do_io(struct hv_device *device,
 
 	vstor_packet->operation = VSTOR_OPERATION_EXECUTE_SRB;
 
+	trace_storvsc_srb_submit(outgoing_channel, request, vstor_packet);
+
 	if (request->payload->range.len) {
 
 		ret = vmbus_sendpacket_mpb_desc(outgoing_channel,
@@ -1720,6 +1819,46 @@ static int storvsc_do_io(struct hv_device *device,
 	return ret;
 }
 
+/*
+ * Fill in the per LUN opcode table. This has to be in place before the
+ * INQUIRY of the scan, which is sent before slave_configure.
+ */
+static void storvsc_setup_cmd_flags(struct stor_mem_pools *memp)
+{
+	u8 *flags = memp->cmd_flags;
+
+	memset(memp->cmd_flags, 0, sizeof(memp->cmd_flags));
+
+	if (vmstor_proto_version <= VMSTOR_PROTO_VERSION_WIN8) {
+		/*
+		 * On legacy hosts filter unimplemented commands.
+		 * Future hosts are expected to correctly handle
+		 * unsupported commands. Furthermore, it is
+		 * possible that some of the currently
+		 * unsupported commands maybe supported in
+		 * future versions of the host.
+		 */
+
+		/* the host does not handle WRITE_SAME, log accident usage */
+		flags[WRITE_SAME] = STORVSC_CMD_REJECT;
+		flags[WRITE_SAME_16] = STORVSC_CMD_REJECT;
+		/*
+		 * smartd sends this command and the host does not handle
+		 * this. So, don't send it.
+		 */
+		flags[SET_WINDOW] = STORVSC_CMD_REJECT;
+	}
+
+	/* See storvsc_on_io_completion() */
+	flags[INQUIRY] = STORVSC_CMD_FIX_STATUS | STORVSC_CMD_FIX_DATA;
+	flags[MODE_SENSE] = STORVSC_CMD_FIX_STATUS;
+
+	if (storvsc_fua || storvsc_write_through) {
+		flags[MODE_SENSE] |= STORVSC_CMD_FIX_DATA;
+		flags[MODE_SENSE_10] |= STORVSC_CMD_FIX_DATA;
+	}
+}
+
 static int storvsc_device_alloc(struct scsi_device *sdevice)
 {
 	struct stor_mem_pools *memp;
@@ -1729,6 +1868,8 @@ static int storvsc_device_alloc(struct scsi_device *sdevice)
 	if (!memp)
 		return -ENOMEM;
 
+	storvsc_setup_cmd_flags(memp);
+
 	memp->request_pool =
 		kmem_cache_create(dev_name(&sdevice->sdev_dev),
 				sizeof(struct storvsc_cmd_request), 0,
@@ -1897,35 +2038,17 @@ static enum blk_eh_timer_return storvsc_eh_timed_out(struct scsi_cmnd *scmnd)
 	return BLK_EH_RESET_TIMER;
 }
 
-static bool storvsc_scsi_cmd_ok(struct scsi_cmnd *scmnd)
+static void storvsc_reject_cmd(struct scsi_cmnd *scmnd)
 {
-	bool allowed = true;
-	u8 scsi_op = scmnd->cmnd[0];
-
-	switch (scsi_op) {
-	/* the host does not handle WRITE_SAME, log accident usage */
-	case WRITE_SAME:
-	case WRITE_SAME_16:
 	/*
-	 * smartd sends this command and the host does not handle
-	 * this. So, don't send it.
+	 * This returned result is an expected divergence from
+	 * upstream code.
 	 */
-	case SET_WINDOW:
-		/*
-		 * This returned result is an expected divergence from
-		 * upstream code.
-		 */
-                scsi_build_sense_buffer(0, scmnd->sense_buffer, ILLEGAL_REQUEST,
-                    0x20, 0);
-                scmnd->result = SAM_STAT_CHECK_CONDITION;
-                set_driver_byte(scmnd, DRIVER_SENSE);
-                set_host_byte(scmnd, DID_ABORT);
-		allowed = false;
-		break;
-	default:
-		break;
-	}
-	return allowed;
+	scsi_build_sense_buffer(0, scmnd->sense_buffer, ILLEGAL_REQUEST,
+				0x20, 0);
+	scmnd->result = SAM_STAT_CHECK_CONDITION;
+	set_driver_byte(scmnd, DRIVER_SENSE);
+	set_host_byte(scmnd, DID_ABORT);
 }
 
 #if (LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,32))
@@ -1957,19 +2080,10 @@ static int storvsc_queuecommand(struct Scsi_Host *host, struct scsi_cmnd *scmnd)
 	u32 length;
 
 
-	if (vmstor_proto_version <= VMSTOR_PROTO_VERSION_WIN8) {
-		/*
-		 * On legacy hosts filter unimplemented commands.
-		 * Future hosts are expected to correctly handle
-		 * unsupported commands. Furthermore, it is
-		 * possible that some of the currently
-		 * unsupported commands maybe supported in
-		 * future versions of the host.
-		 */
-		if (!storvsc_scsi_cmd_ok(scmnd)) {
-			scmnd->scsi_done(scmnd);
-			return 0;
-		}
+	if (unlikely(memp->cmd_flags[scmnd->cmnd[0]] & STORVSC_CMD_REJECT)) {
+		storvsc_reject_cmd(scmnd);
+		scmnd->scsi_done(scmnd);
+		return 0;
 	}
 
 	request_size = sizeof(struct storvsc_cmd_request);
@@ -0,0 +1,75 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM storvsc
+
+#if !defined(_STORVSC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _STORVSC_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * SRB submit and completion. These events are a stable interface for
+ * tracing tools: names and TP_PROTO arguments are kept across releases.
+ * The request pointer is the VMBus transaction id and matches a submit
+ * with its completion.
+ */
+
+TRACE_EVENT(storvsc_srb_submit,
+	TP_PROTO(const struct vmbus_channel *channel,
+		 const struct storvsc_cmd_request *request,
+		 const struct vstor_packet *vstor_packet),
+	TP_ARGS(channel, request, vstor_packet),
+	TP_STRUCT__entry(
+		__field(const void *, request)
+		__field(u32, relid)
+		__field(u32, len)
+		__field(u8, target)
+		__field(u8, lun)
+		__field(u8, cdb0)
+	),
+	TP_fast_assign(
+		__entry->request = request;
+		__entry->relid	 = channel->offermsg.child_relid;
+		__entry->len	 = vstor_packet->vm_srb.data_transfer_length;
+		__entry->target	 = vstor_packet->vm_srb.target_id;
+		__entry->lun	 = vstor_packet->vm_srb.lun;
+		__entry->cdb0	 = vstor_packet->vm_srb.cdb[0];
+	),
+	TP_printk("req=%p relid=0x%x target=%u lun=%u op=0x%02x len=%u",
+		  __entry->request, __entry->relid, __entry->target,
+		  __entry->lun, __entry->cdb0, __entry->len)
+);
+
+TRACE_EVENT(storvsc_srb_complete,
+	TP_PROTO(const struct vmbus_channel *channel,
+		 const struct vmpacket_descriptor *desc,
+		 const struct vstor_packet *vstor_packet),
+	TP_ARGS(channel, desc, vstor_packet),
+	TP_STRUCT__entry(
+		__field(u64, request)
+		__field(u32, relid)
+		__field(u32, len)
+		__field(u8, operation)
+		__field(u8, srb_status)
+		__field(u8, scsi_status)
+	),
+	TP_fast_assign(
+		__entry->request     = desc->trans_id;
+		__entry->relid	     = channel->offermsg.child_relid;
+		__entry->len	     = vstor_packet->vm_srb.data_transfer_length;
+		__entry->operation   = vstor_packet->operation;
+		__entry->srb_status  = vstor_packet->vm_srb.srb_status;
+		__entry->scsi_status = vstor_packet->vm_srb.scsi_status;
+	),
+	TP_printk("req=0x%llx relid=0x%x op=%u srb=0x%x scsi=0x%x len=%u",
+		  __entry->request, __entry->relid, __entry->operation,
+		  __entry->srb_status, __entry->scsi_status, __entry->len)
+);
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE storvsc_trace
+#endif /* _STORVSC_TRACE_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
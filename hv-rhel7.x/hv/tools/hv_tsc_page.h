@@ -0,0 +1,122 @@
+/*
+ * Userspace reader for the Hyper-V reference TSC page.
+ *
+ * Copyright (C) 2017, Microsoft, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE, GOOD TITLE or
+ * NON INFRINGEMENT.  See the GNU General Public License for more
+ * details.
+ *
+ * The hv_vmbus module exports the reference TSC page read-only through
+ * /dev/hv_tsc_page. Mapping it lets an application read the partition
+ * reference time (100ns units) without entering the kernel, using the
+ * same sequence/scale/offset protocol as hv_read_tsc_page() in
+ * arch/x86/include/lis/asm/mshyperv.h.
+ *
+ * Usage:
+ *	const struct hv_tsc_page *pg = hv_tsc_page_map();
+ *	uint64_t t = hv_tsc_page_read(pg);
+ *	if (t == HV_TSC_PAGE_INVALID)
+ *		... fall back to clock_gettime() ...
+ */
+
+#ifndef _HV_TSC_PAGE_H
+#define _HV_TSC_PAGE_H
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define HV_TSC_PAGE_DEV		"/dev/hv_tsc_page"
+#define HV_TSC_PAGE_SIZE	4096
+#define HV_TSC_PAGE_INVALID	UINT64_MAX
+
+struct hv_tsc_page {
+	volatile uint32_t tsc_sequence;
+	uint32_t reserved1;
+	volatile uint64_t tsc_scale;
+	volatile int64_t tsc_offset;
+};
+
+static inline const struct hv_tsc_page *hv_tsc_page_map(void)
+{
+	void *pg;
+	int fd;
+
+	fd = open(HV_TSC_PAGE_DEV, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	pg = mmap(NULL, HV_TSC_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (pg == MAP_FAILED)
+		return NULL;
+
+	return pg;
+}
+
+static inline void hv_tsc_page_unmap(const struct hv_tsc_page *pg)
+{
+	if (pg)
+		munmap((void *)pg, HV_TSC_PAGE_SIZE);
+}
+
+static inline uint64_t hv_tsc_page_rdtsc(void)
+{
+	uint32_t lo, hi;
+
+	/* Order the TSC read against the loads from the TSC page */
+	__asm__ __volatile__("lfence; rdtsc" : "=a" (lo), "=d" (hi) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+/*
+ * Returns the reference time in 100ns units, or HV_TSC_PAGE_INVALID when
+ * the host has invalidated the page (e.g. during live migration); callers
+ * must then fall back to a syscall based clock.
+ */
+static inline uint64_t hv_tsc_page_read(const struct hv_tsc_page *pg)
+{
+	uint64_t scale, tsc;
+	int64_t offset;
+	uint32_t sequence;
+
+	if (!pg)
+		return HV_TSC_PAGE_INVALID;
+
+	do {
+		sequence = pg->tsc_sequence;
+		if (sequence == 0)
+			return HV_TSC_PAGE_INVALID;
+		__asm__ __volatile__("" ::: "memory");
+
+		scale = pg->tsc_scale;
+		offset = pg->tsc_offset;
+		tsc = hv_tsc_page_rdtsc();
+
+		__asm__ __volatile__("" ::: "memory");
+	} while (pg->tsc_sequence != sequence);
+
+	/* tick = ((tsc * scale) >> 64) + offset */
+	return (uint64_t)(((unsigned __int128)tsc * scale) >> 64) + offset;
+}
+
+static inline uint64_t hv_tsc_page_read_ns(const struct hv_tsc_page *pg)
+{
+	uint64_t tick = hv_tsc_page_read(pg);
+
+	if (tick == HV_TSC_PAGE_INVALID)
+		return tick;
+
+	return tick * 100;
+}
+
+#endif /* _HV_TSC_PAGE_H */
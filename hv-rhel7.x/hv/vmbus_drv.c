@@ -807,8 +807,11 @@ static void vmbus_channel_isr(struct vmbus_channel *channel)
 	void (*callback_fn)(void *);
 
 	callback_fn = READ_ONCE(channel->onchannel_callback);
-	if (likely(callback_fn != NULL))
+	if (likely(callback_fn != NULL)) {
+		trace_vmbus_chan_cb_enter(channel);
 		(*callback_fn)(channel->channel_callback_context);
+		trace_vmbus_chan_cb_exit(channel);
+	}
 }
 
 /*
@@ -862,6 +865,8 @@ static void vmbus_chan_sched(struct hv_per_cpu_context *hv_cpu)
 
 			trace_vmbus_chan_sched(channel);
 
+			++channel->interrupts;
+
 			switch (channel->callback_mode) {
 			case HV_CALL_ISR:
 				vmbus_channel_isr(channel);
@@ -1327,6 +1332,20 @@ static ssize_t subchannel_id_show(const struct vmbus_channel *channel,
 }
 static VMBUS_CHAN_ATTR_RO(subchannel_id);
 
+static ssize_t channel_interrupts_show(const struct vmbus_channel *channel,
+				       char *buf)
+{
+	return sprintf(buf, "%llu\n", channel->interrupts);
+}
+static VMBUS_CHAN_ATTR(interrupts, S_IRUGO, channel_interrupts_show, NULL);
+
+static ssize_t channel_events_show(const struct vmbus_channel *channel,
+				   char *buf)
+{
+	return sprintf(buf, "%llu\n", channel->sig_events);
+}
+static VMBUS_CHAN_ATTR(events, S_IRUGO, channel_events_show, NULL);
+
 static struct attribute *vmbus_chan_attrs[] = {
 	&chan_attr_out_mask.attr,
 	&chan_attr_in_mask.attr,
@@ -1337,6 +1356,8 @@ static struct attribute *vmbus_chan_attrs[] = {
 	&chan_attr_latency.attr,
 	&chan_attr_monitor_id.attr,
 	&chan_attr_subchannel_id.attr,
+	&chan_attr_interrupts.attr,
+	&chan_attr_events.attr,
 	NULL
 };
 
@@ -1854,6 +1875,9 @@ static int __init hv_acpi_init(void)
 #endif
 	if (ret)
 		goto cleanup;
+
+	hyperv_add_tsc_page_dev();
+	hv_apic_init();
 #if (RHEL_RELEASE_CODE >= RHEL_RELEASE_VERSION(7,3))
 	hv_setup_kexec_handler(hv_kexec_handler);
 	hv_setup_crash_handler(hv_crash_handler);
@@ -1908,6 +1932,8 @@ static void __exit vmbus_exit(void)
 	hv_cpu_hotplug_quirk(false);
 #endif
 	hv_synic_free();
+	hyperv_remove_tsc_page_dev();
+	hv_apic_cleanup();
 	acpi_bus_unregister_driver(&vmbus_acpi_driver);
 }
 